@@ -1,5 +1,6 @@
 #include "memory/memory.hpp"
 #include <stdlib.h>
+#include <string.h>
 #include <logger.h>
 
 #include <cpu/cpu.hpp>
@@ -9,7 +10,7 @@
 
 #include <libs/function.hpp>
 
-#include <memory/virtual.hpp>
+#include <memory/heap.hpp>
 
 namespace cpu
 {
@@ -59,16 +60,22 @@ struct FpuFeatures
 	size_t storage_size;
 } fpu_features;
 
+// XSAVE needs a 64-byte aligned area, and xrstor faults on a header that isn't zeroed.
 void* allocate_fpu_buffer()
 {
-	const size_t fpu_pages = memory::div_roundup(fpu_features.storage_size, PAGE_SIZE);
-	return memory::virtual_allocate(fpu_pages);
+	void* buffer = memory::heap_cache_aligned_alloc(fpu_features.storage_size);
+
+	if(buffer != nullptr)
+	{
+		memset(buffer, 0, fpu_features.storage_size);
+	}
+
+	return buffer;
 }
 
 void free_fpu_buffer(void* buffer)
 {
-	const size_t fpu_pages = memory::div_roundup(fpu_features.storage_size, PAGE_SIZE);
-	memory::virtual_free(buffer, fpu_pages);
+	memory::heap_free(buffer);
 }
 
 void initialize_sse()
@@ -195,7 +202,7 @@ void initialize()
 		fpu_features.storage_size = 512;
 	}
 
-	fpu_init_states = static_cast<uint8_t*>(calloc(fpu_features.storage_size, sizeof(uint8_t)));
+	fpu_init_states = static_cast<uint8_t*>(allocate_fpu_buffer());
 
 	log_begin_intialization("Streaming SIMD Extensions");
 
@@ -1,3 +1,4 @@
+#include <arch.hpp>
 #include <logger.h>
 #include <libs/trace.h>
 #include <stdlib.h>
@@ -5,6 +6,8 @@
 
 #include <drivers/interrupts.hpp>
 
+#include <memory/virtual.hpp>
+
 #include <cpu/cpu.hpp>
 #include <cpu/idt.hpp>
 #include <cpu/gdt.hpp>
@@ -83,11 +86,47 @@ void dump_page_fault_error(Iframe* iframe, uintptr_t cr2)
 			  error_code & PAGE_FAULT_PRESENT ? "protection violation" : "page not present");
 }
 
+// Only kernel data accesses can touch a reserved region that isn't backed yet. Backing a page
+// takes locks whose holders may wait for this CPU to take a shootdown IPI, so interrupts are
+// enabled again if the faulting code had them on. CR2 is read first, a nested fault changes it.
+static bool handle_page_fault(Iframe* iframe)
+{
+	const uint64_t ignored =
+		PAGE_FAULT_USER | PAGE_FAULT_RESERVE_WRITE | PAGE_FAULT_INSTRUCTION_FETCH;
+
+	if(iframe->err_code & ignored)
+	{
+		return false;
+	}
+
+	const uintptr_t address = read_cr2();
+	const bool interrupts = iframe->flags & FLAGS_IF;
+
+	if(interrupts)
+	{
+		enable_interrupts();
+	}
+
+	const bool ret = memory::virtual_handle_fault(address, iframe->err_code & PAGE_FAULT_WRITE);
+
+	if(interrupts)
+	{
+		disable_interrupts();
+	}
+
+	return ret;
+}
+
 void exception_handler(Iframe* iframe)
 {
+	if((iframe->vector == EXCEPTION_PAGE_FAULT) && handle_page_fault(iframe))
+	{
+		return;
+	}
+
 	dump_stacktrace();
 
-	if(iframe->err_code == EXCEPTION_PAGE_FAULT)
+	if(iframe->vector == EXCEPTION_PAGE_FAULT)
 	{
 		dump_page_fault_error(iframe, read_cr2());
 	}
@@ -204,7 +243,11 @@ extern "C"
 
 		handler(iframe);
 
-		issue_eoi(iframe->vector);
+		// Exceptions that return, like resolved page faults, have nothing to acknowledge.
+		if(iframe->vector >= PLATFORM_INTERRUPT_BASE)
+		{
+			issue_eoi(iframe->vector);
+		}
 	}
 
 	void nmi_handler(Nmiframe* iframe)
@@ -254,6 +254,8 @@ void send_ipi(uint8_t vector, uint32_t dest_apic_id, interrupt_delivery_mode del
 		return write_msr(LAPIC_X2APIC_MSR_ICR, X2_ICR_DST(dest_apic_id) | request);
 	}
 
+	// Callers may already run with interrupts disabled, e.g. during a TLB shootdown.
+	const bool interrupts = arch::interrupt_status();
 	disable_interrupts();
 
 	write_reg(LAPIC_REG_IRQ_CMD_HIGH, ICR_DST(dest_apic_id));
@@ -261,7 +263,10 @@ void send_ipi(uint8_t vector, uint32_t dest_apic_id, interrupt_delivery_mode del
 
 	wait_for_ipi_send();
 
-	enable_interrupts();
+	if(interrupts)
+	{
+		enable_interrupts();
+	}
 }
 
 void send_self_ipi(uint8_t vector, interrupt_delivery_mode delivery_mode)
@@ -0,0 +1,93 @@
+#include <cpu/cpu.hpp>
+#include <cpu/features.h>
+#include <cpu/pmu.hpp>
+#include <cpu/registers.h>
+
+// Event select bits shared by the Intel and AMD counters.
+#define PERFEVTSEL_OS (1ul << 17)
+#define PERFEVTSEL_ENABLE (1ul << 22)
+
+namespace cpu
+{
+namespace pmu
+{
+struct EventCode
+{
+	uint8_t intel_event;
+	uint8_t intel_umask;
+	uint8_t amd_event;
+	uint8_t amd_umask;
+};
+
+// DTLB_LOAD_MISSES.WALK_COMPLETED (Haswell and later) and LsL1DTlbMiss (Zen).
+static constexpr EventCode event_codes[] = {
+	{0x08, 0x0e, 0x45, 0xff},
+};
+
+static uint32_t select_msr = 0;
+static uint32_t counter_msr = 0;
+
+static bool has_intel_counters()
+{
+	CpuidLeaf leaf = {};
+
+	// Version and number of general purpose counters of the architectural PMU.
+	return (read_cpuid(&leaf, CPUID_PERFORMANCE_MONITORING, 0) == SYSTEM_OK) &&
+		   ((leaf.values[0] & 0xff) != 0) && (((leaf.values[0] >> 8) & 0xff) != 0);
+}
+
+bool start(Event event)
+{
+	const EventCode& code = event_codes[static_cast<int>(event)];
+	uint64_t select = PERFEVTSEL_OS | PERFEVTSEL_ENABLE;
+
+	if(has_intel_counters())
+	{
+		select_msr = MSR_PERFEVTSEL0;
+		counter_msr = MSR_PMC0;
+		select |= code.intel_event | (code.intel_umask << 8);
+	}
+	else if(test_feature(FEATURE_PERFCTR_CORE))
+	{
+		select_msr = MSR_AMD_PERF_CTL0;
+		counter_msr = MSR_AMD_PERF_CTR0;
+		select |= code.amd_event | (code.amd_umask << 8);
+	}
+	else
+	{
+		return false;
+	}
+
+	write_msr(select_msr, 0);
+	write_msr(counter_msr, 0);
+
+	// From version 2 on, counters also have to be enabled globally.
+	if(select_msr == MSR_PERFEVTSEL0)
+	{
+		CpuidLeaf leaf = {};
+		read_cpuid(&leaf, CPUID_PERFORMANCE_MONITORING, 0);
+
+		if((leaf.values[0] & 0xff) >= 2)
+		{
+			write_msr(MSR_PERF_GLOBAL_CTRL, read_msr(MSR_PERF_GLOBAL_CTRL) | 1);
+		}
+	}
+
+	write_msr(select_msr, select);
+	return true;
+}
+
+uint64_t read()
+{
+	return (counter_msr != 0) ? read_msr(counter_msr) : 0;
+}
+
+void stop()
+{
+	if(select_msr != 0)
+	{
+		write_msr(select_msr, 0);
+	}
+}
+} // namespace pmu
+} // namespace cpu
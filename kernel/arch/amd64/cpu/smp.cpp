@@ -1,18 +1,22 @@
 #include "cpu/fpu.hpp"
 #include "memory/paging.hpp"
+#include <memory/memory.hpp>
 #include <cpu/gdt.hpp>
 #include <cpu/idt.hpp>
 #include <cpu/smp.hpp>
 #include <cpu/arch_smp.hpp>
 #include <cpu/cpu.hpp>
 #include <cpu/lapic.hpp>
+#include <cpu/tlb.hpp>
 #include <libs/vector.hpp>
 
+#include <drivers/interrupts.hpp>
+
 namespace cpu
 {
 namespace smp
 {
-extern std::vector<PlatformCpuData> cpu_datas;
+extern PlatformCpuData* cpu_datas;
 
 PlatformCpuData* get_cpu_data()
 {
@@ -26,9 +30,10 @@ void initialize_base_cpu(limine_smp_info* cpu)
 	PlatformCpuData* cpu_data = reinterpret_cast<PlatformCpuData*>(cpu->extra_argument);
 
 	cpu_data->self = cpu_data;
-	cpu_data->gdt = new gdt::GdtTable;
-	cpu_data->idt = new interrupts::IdtTable;
-	cpu_data->tss = new gdt::Tss;
+	// The IDT fills exactly one page, and the TSS header must not cross a page boundary.
+	cpu_data->gdt = new(std::align_val_t(CACHE_LINE_SIZE)) gdt::GdtTable;
+	cpu_data->idt = new(std::align_val_t(PAGE_SIZE)) interrupts::IdtTable;
+	cpu_data->tss = new(std::align_val_t(PAGE_SIZE)) gdt::Tss;
 
 	cpu_data->tss->initialize();
 
@@ -38,8 +43,25 @@ void initialize_base_cpu(limine_smp_info* cpu)
 	cpu::set_kernel_gs_base(cpu->extra_argument);
 	cpu::set_gs_base(cpu->extra_argument);
 
+	memory::paging_initialize_cpu();
+
 	apic::initialize_lapic_virt();
 	apic::initialize_lapic();
+
+	tlb::initialize();
+
+	// Waking a halted CPU only needs the interrupt, there is nothing to handle.
+	auto& handler = drivers::interrupts::get_handler(INTERRUPT_IPI_GENERIC);
+	handler.reserved = true;
+	handler.vector = INTERRUPT_IPI_GENERIC;
+
+	handler.set([](Iframe*) {});
+}
+
+void wake(size_t id)
+{
+	apic::send_ipi(INTERRUPT_IPI_GENERIC, static_cast<uint32_t>(get_cpu_data(id)->local_apic_id),
+				   apic::DELIVERY_MODE_FIXED);
 }
 
 void initialize_cpu(limine_smp_info* cpu)
@@ -50,20 +72,30 @@ void initialize_cpu(limine_smp_info* cpu)
 	if(cpu_data->local_apic_id != apic::bsp_id())
 	{
 		cpu::enable_pat();
-		memory::base_pagemap.load();
+
+		// load() needs the per-CPU data, which is only mapped by the kernel's tables.
+		cpu::write_cr3(memory::from_higher_half(
+			reinterpret_cast<uintptr_t>(memory::base_pagemap.get_table())));
+
+		// Per-CPU data has to be reachable before the first allocation on this CPU.
+		cpu::set_kernel_gs_base(cpu->extra_argument);
+		cpu::set_gs_base(cpu->extra_argument);
 
 		cpu_data->self = cpu_data;
-		cpu_data->gdt = new gdt::GdtTable;
-		cpu_data->idt = new interrupts::IdtTable;
-		cpu_data->tss = new gdt::Tss;
+		cpu_data->gdt = new(std::align_val_t(CACHE_LINE_SIZE)) gdt::GdtTable;
+		cpu_data->idt = new(std::align_val_t(PAGE_SIZE)) interrupts::IdtTable;
+		cpu_data->tss = new(std::align_val_t(PAGE_SIZE)) gdt::Tss;
 
 		cpu_data->tss->initialize();
 
 		gdt::initialize(cpu_data->gdt, cpu_data->tss);
 		interrupts::initialize(cpu_data->idt);
 
+		// Reloading the segment selectors cleared the GS base again.
 		cpu::set_kernel_gs_base(cpu->extra_argument);
 		cpu::set_gs_base(cpu->extra_argument);
+
+		memory::paging_initialize_cpu();
 	}
 
 	fpu::initialize_sse();
@@ -0,0 +1,212 @@
+#include <arch.hpp>
+#include <logger.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <mmu.hpp>
+#include <memory/memory.hpp>
+
+#include <cpu/cpu.hpp>
+#include <cpu/features.h>
+#include <cpu/idt.hpp>
+#include <cpu/lapic.hpp>
+#include <cpu/smp.hpp>
+#include <cpu/arch_smp.hpp>
+#include <cpu/tlb.hpp>
+
+#include <drivers/interrupts.hpp>
+
+namespace cpu
+{
+namespace tlb
+{
+static std::atomic_size_t ipis_sent = 0;
+static std::atomic_size_t batches_handled = 0;
+static std::atomic_size_t pages_invalidated = 0;
+static std::atomic_size_t full_flushes = 0;
+
+// Entries of a PCID that is not loaded can't be reached by invlpg. Without INVPCID the PCID is
+// marked as not flushed instead, so the next load() of it flushes.
+static void forget_pcid(smp::PlatformCpuData* cpu_data, uint16_t pcid)
+{
+	cpu_data->pcid_flushed[pcid / 64] &= ~(1ul << (pcid % 64));
+}
+
+// Runs with interrupts disabled, on the CPU the mailbox belongs to.
+static void drain(smp::PlatformCpuData* cpu_data)
+{
+	Mailbox& mailbox = cpu_data->tlb_mailbox;
+	uintptr_t addresses[TLB_SHOOTDOWN_BATCH];
+	uint16_t pcids[TLB_SHOOTDOWN_BATCH];
+	size_t count = 0;
+	bool flush_all = false;
+	bool flush_global = false;
+	uint64_t sequence = 0;
+
+	{
+		lock::ScopedLock guard(mailbox.lock);
+
+		count = mailbox.count;
+		flush_all = mailbox.flush_all;
+		flush_global = mailbox.flush_global;
+		sequence = mailbox.requested;
+
+		std::copy(mailbox.addresses, mailbox.addresses + count, addresses);
+		std::copy(mailbox.pcids, mailbox.pcids + count, pcids);
+
+		mailbox.count = 0;
+		mailbox.flush_all = false;
+		mailbox.flush_global = false;
+		mailbox.ipi_pending = false;
+	}
+
+	if(sequence == mailbox.completed.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	const bool pcid = read_cr4() & CR4_PCIDE;
+	const uint16_t current = pcid ? (read_cr3() & CR3_PCID_MASK) : 0;
+
+	if(flush_global)
+	{
+		x86_tlb_global_invalidate();
+		full_flushes++;
+	}
+	else if(flush_all)
+	{
+		// Without INVPCID only the loaded PCID is flushed here, the others on their next load.
+		x86_tlb_nonglobal_invalidate(0);
+
+		if(pcid && !test_feature(FEATURE_INVPCID))
+		{
+			memset(cpu_data->pcid_flushed, 0, sizeof(cpu_data->pcid_flushed));
+			cpu_data->pcid_flushed[current / 64] |= 1ul << (current % 64);
+		}
+
+		full_flushes++;
+	}
+	else
+	{
+		for(size_t i = 0; i < count; i++)
+		{
+			if(!pcid || memory::is_higher_half(addresses[i]) || (pcids[i] == current))
+			{
+				invalidate_page(addresses[i]);
+			}
+			else if(test_feature(FEATURE_INVPCID))
+			{
+				invpcid_va_pcid(addresses[i], pcids[i]);
+			}
+			else
+			{
+				forget_pcid(cpu_data, pcids[i]);
+			}
+		}
+
+		pages_invalidated += count;
+	}
+
+	batches_handled++;
+	mailbox.completed.store(sequence, std::memory_order_release);
+}
+
+void initialize()
+{
+	auto& handler = drivers::interrupts::get_handler(INTERRUPT_IPI_TLB_SHOOTDOWN);
+	handler.reserved = true;
+	handler.vector = INTERRUPT_IPI_TLB_SHOOTDOWN;
+
+	handler.set([](Iframe*) {
+		drain(smp::get_cpu_data());
+	});
+}
+
+void queue(size_t cpu, const uintptr_t* addresses, size_t count, uint16_t pcid, bool flush_all,
+		   bool global)
+{
+	smp::PlatformCpuData* cpu_data = smp::get_cpu_data(cpu);
+	Mailbox& mailbox = cpu_data->tlb_mailbox;
+	const bool interrupts = arch::interrupt_status();
+	bool send = false;
+
+	disable_interrupts();
+
+	{
+		lock::ScopedLock guard(mailbox.lock);
+
+		if(flush_all || ((mailbox.count + count) > TLB_SHOOTDOWN_BATCH))
+		{
+			mailbox.flush_all = true;
+			mailbox.flush_global |= global;
+		}
+		else
+		{
+			std::copy(addresses, addresses + count, mailbox.addresses + mailbox.count);
+			std::fill(mailbox.pcids + mailbox.count, mailbox.pcids + mailbox.count + count, pcid);
+			mailbox.count += count;
+		}
+
+		mailbox.requested++;
+		send = !mailbox.ipi_pending;
+		mailbox.ipi_pending = true;
+	}
+
+	// Writing the ICR is not serializing with the x2APIC, the request has to be visible first.
+	if(send)
+	{
+		asm volatile("mfence" ::: "memory");
+		apic::send_ipi(INTERRUPT_IPI_TLB_SHOOTDOWN, static_cast<uint32_t>(cpu_data->local_apic_id),
+					   apic::DELIVERY_MODE_FIXED);
+		ipis_sent++;
+	}
+
+	if(interrupts)
+	{
+		enable_interrupts();
+	}
+}
+
+void wait()
+{
+	smp::PlatformCpuData* self = smp::get_cpu_data();
+	const bool interrupts = arch::interrupt_status();
+
+	for(size_t i = 0; i < smp::get_cpu_count(); i++)
+	{
+		smp::PlatformCpuData* cpu_data = smp::get_cpu_data(i);
+		Mailbox& mailbox = cpu_data->tlb_mailbox;
+
+		if((cpu_data == self) || !cpu_data->is_up)
+		{
+			continue;
+		}
+
+		// Later requests may keep coming in, only the ones queued so far are waited for.
+		const uint64_t sequence = __atomic_load_n(&mailbox.requested, __ATOMIC_ACQUIRE);
+
+		while(mailbox.completed.load(std::memory_order_acquire) < sequence)
+		{
+			disable_interrupts();
+			drain(self);
+
+			if(interrupts)
+			{
+				enable_interrupts();
+			}
+
+			pause();
+		}
+	}
+}
+
+void get_status(ShootdownStats* status)
+{
+	status->ipis_sent = ipis_sent.load(std::memory_order_relaxed);
+	status->batches_handled = batches_handled.load(std::memory_order_relaxed);
+	status->pages_invalidated = pages_invalidated.load(std::memory_order_relaxed);
+	status->full_flushes = full_flushes.load(std::memory_order_relaxed);
+}
+} // namespace tlb
+} // namespace cpu
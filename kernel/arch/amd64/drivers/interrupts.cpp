@@ -96,7 +96,8 @@ void issue_eoi(int vector)
 {
 	assert((vector >= PLATFORM_INTERRUPT_BASE));
 
-	if(cpu::apic::io_apic_initialized())
+	// Local APIC vectors are acknowledged there even while the legacy PIC routes the IRQs.
+	if(cpu::apic::io_apic_initialized() || (vector >= INTERRUPT_LOCAL_APIC_BASE))
 	{
 		cpu::apic::issue_eoi();
 	}
@@ -1,6 +1,9 @@
+#include <arch.hpp>
 #include <logger.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include <mmu.hpp>
 #include <memory/memory.hpp>
 #include <memory/paging.hpp>
@@ -9,18 +12,63 @@
 
 #include <cpu/cpu.hpp>
 #include <cpu/features.h>
+#include <cpu/smp.hpp>
+#include <cpu/arch_smp.hpp>
+#include <cpu/tlb.hpp>
+
+#include <drivers/timers.hpp>
+
+#define GET_PML_ENTRY(virtual_address, offset) (((virtual_address) >> (offset)) & 0x1fful)
+
+// Pages a range operation invalidates one by one before falling back to a full flush.
+#define RANGE_INVALIDATE_BATCH 32
 
-#define GET_PML_ENTRY(virtual_address, offset) (((virtual_address) >> offset) & 0x1fful)
+// Page tables collected before waiting for lockless walks and freeing them at once.
+#define RETIRED_TABLES_BATCH 64
+
+// Emptied tables a range operation unlinks before it flushes the TLB and retires them. The walk
+// stops a few short of it, so every level it returns through can still unlink its table.
+#define RANGE_TABLE_BATCH 32
+#define RANGE_TABLE_RESERVE 4
+
+// Time between two steps of the background collapse of kernel tables.
+#define COLLAPSE_INTERVAL_MS 100
+
+// Mapping touched on every switch by paging_benchmark_switch.
+#define SWITCH_BENCHMARK_ADDRESS 0x40000000ul
+#define SWITCH_BENCHMARK_PAGES 64
+#define SWITCH_BENCHMARK_ROUNDS 1000
 
 namespace memory
 {
 namespace virt
 {
 static bool pml3_translation = false;
+static bool pcid_translation = false;
+
+// PCIDs are handed out in generations. Once all of them are used, a new generation starts and
+// every CPU flushes a PCID before it trusts its TLB entries again. PCID 0 is left to boot.
+static lock::mutex pcid_lock;
+static uint64_t pcid_generation = 1;
+static uint16_t pcid_next = 1;
+
+// Lockless walks publish the epoch they started in. A table unlinked before the epoch moved on
+// is freed once no CPU is still walking in an older epoch.
+static std::atomic<uint64_t> table_epoch = 1;
+static lock::mutex retire_lock;
+static void* retired_tables[RETIRED_TABLES_BATCH];
+static bool retired_zeroed[RETIRED_TABLES_BATCH];
+static size_t retired_count = 0;
+
+// Background collapse state. Every step looks at the next top level entry of the kernel half.
+static lock::mutex collapse_lock;
+static size_t collapse_next_run = 0;
+static size_t collapse_slot = 256;
+static size_t collapsed_tables = 0;
 
 constexpr size_t parse_cache(size_t flags, size_t page_size)
 {
-	std::size_t patbit = (page_size > PAGE_SIZE) ? (1 << 12) : (1 << 7);
+	std::size_t patbit = (page_size > PAGE_SIZE) ? PAGE_FLAG_LARGE_PAT : PAGE_FLAG_PAT;
 	std::size_t ret = 0;
 
 	if(flags & MAP_MMIO)
@@ -113,6 +161,199 @@ constexpr size_t flag_to_page_size(size_t flags)
 	return PAGE_SIZE;
 }
 
+static int top_level()
+{
+	return is_paging_mode_max() ? 5 : 4;
+}
+
+constexpr size_t level_page_size(int level)
+{
+	return PAGE_SIZE << (9 * (level - 1));
+}
+
+// Marks a lockless walk on the calling CPU. A walk in an interrupt handler keeps the epoch of
+// the walk it interrupted, which is older and so only keeps tables around for longer.
+class TableWalkGuard
+{
+  public:
+	TableWalkGuard()
+	{
+		if(!cpu::smp::cpu_data_initialized())
+		{
+			return;
+		}
+
+		this->epoch_ = &cpu::smp::get_cpu_data()->table_walk_epoch;
+
+		if(this->epoch_->load(std::memory_order_relaxed) == 0)
+		{
+			this->epoch_->store(virt::table_epoch.load());
+			this->outer_ = true;
+		}
+	}
+
+	~TableWalkGuard()
+	{
+		if(this->outer_)
+		{
+			this->epoch_->store(0, std::memory_order_release);
+		}
+	}
+
+	TableWalkGuard(const TableWalkGuard&) = delete;
+	TableWalkGuard& operator=(const TableWalkGuard&) = delete;
+
+  private:
+	std::atomic<uint64_t>* epoch_ = nullptr;
+	bool outer_ = false;
+};
+
+// Waits until no lockless walk that may have seen a table unlinked before the call is running.
+static void wait_for_table_walks()
+{
+	const uint64_t epoch = ++virt::table_epoch;
+
+	for(size_t i = 0; i < cpu::smp::get_cpu_count(); i++)
+	{
+		const std::atomic<uint64_t>& walk = cpu::smp::get_cpu_data(i)->table_walk_epoch;
+		uint64_t current = walk.load();
+
+		while((current != 0) && (current < epoch))
+		{
+			pause();
+			current = walk.load();
+		}
+	}
+}
+
+// Tables only come from and go to the cache of the CPU running, with interrupts disabled.
+static void* table_cache_allocate()
+{
+	const bool interrupts = arch::interrupt_status();
+	disable_interrupts();
+
+	cpu::smp::PlatformCpuData* cpu_data = cpu::smp::get_cpu_data();
+
+	if(cpu_data->page_table_cache_count == 0)
+	{
+		physical_allocate_bulk(cpu_data->page_table_cache, PAGE_TABLE_CACHE_BATCH);
+		cpu_data->page_table_cache_count = PAGE_TABLE_CACHE_BATCH;
+	}
+
+	void* ret = cpu_data->page_table_cache[--cpu_data->page_table_cache_count];
+
+	if(interrupts)
+	{
+		enable_interrupts();
+	}
+
+	return ret;
+}
+
+static void table_cache_free(void* table)
+{
+	const bool interrupts = arch::interrupt_status();
+	disable_interrupts();
+
+	cpu::smp::PlatformCpuData* cpu_data = cpu::smp::get_cpu_data();
+
+	if(cpu_data->page_table_cache_count < PAGE_TABLE_CACHE_SIZE)
+	{
+		cpu_data->page_table_cache[cpu_data->page_table_cache_count++] = table;
+		table = nullptr;
+	}
+
+	if(interrupts)
+	{
+		enable_interrupts();
+	}
+
+	physical_free(table);
+}
+
+// Unlinked tables are freed in batches, once no lockless walk can still be reading them. Tables
+// that were emptied are still zeroed and go back to the table cache.
+// The batch is taken out under the lock, but waited for and freed after dropping it.
+static void retire_table(void* table, bool zeroed = false)
+{
+	void* tables[RETIRED_TABLES_BATCH];
+	bool tables_zeroed[RETIRED_TABLES_BATCH];
+	size_t count = 0;
+
+	{
+		lock::ScopedLock guard(virt::retire_lock);
+
+		virt::retired_tables[virt::retired_count] = table;
+		virt::retired_zeroed[virt::retired_count++] = zeroed;
+
+		if(virt::retired_count < RETIRED_TABLES_BATCH)
+		{
+			return;
+		}
+
+		count = virt::retired_count;
+		std::copy(virt::retired_tables, virt::retired_tables + count, tables);
+		std::copy(virt::retired_zeroed, virt::retired_zeroed + count, tables_zeroed);
+		virt::retired_count = 0;
+	}
+
+	if(!cpu::smp::cpu_data_initialized())
+	{
+		physical_free_bulk(tables, count);
+		return;
+	}
+
+	wait_for_table_walks();
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if(tables_zeroed[i])
+		{
+			table_cache_free(tables[i]);
+		}
+		else
+		{
+			physical_free(tables[i]);
+		}
+	}
+}
+
+static PageFrame* table_frame(PageTableEntry* entry)
+{
+	return physical_get_frame(from_higher_half(
+		reinterpret_cast<void*>(align_down(reinterpret_cast<uintptr_t>(entry), PAGE_SIZE))));
+}
+
+// Stores an entry and keeps the count of used entries of its table up to date.
+static void set_entry(PageTableEntry& entry, uintptr_t value)
+{
+	const uintptr_t old = entry.val;
+
+	entry.store(value);
+
+	if((old == 0) && (value != 0))
+	{
+		table_frame(&entry)->entries++;
+	}
+	else if((old != 0) && (value == 0))
+	{
+		table_frame(&entry)->entries--;
+	}
+}
+
+// Page tables are tagged with the page map they belong to.
+static void* allocate_table(PageMap* owner)
+{
+	void* ret = cpu::smp::cpu_data_initialized() ? table_cache_allocate() : physical_allocate();
+	PageFrame* frame = physical_get_frame(ret);
+
+	frame->flags |= FRAME_FLAG_PAGE_TABLE;
+	frame->owner = reinterpret_cast<uintptr_t>(owner);
+	frame->entries = 0;
+
+	return ret;
+}
+
 PageMap::~PageMap()
 {
 	this->destroy_level(this->top_lvl_, 0, 256, is_paging_mode_max() ? 5 : 4);
@@ -120,12 +361,18 @@ PageMap::~PageMap()
 
 void PageMap::initialize(bool kernel_pagemap)
 {
-	this->top_lvl_ = static_cast<PageTable*>(to_higher_half(physical_allocate()));
+	void* top_lvl = physical_allocate(1, PHYS_ALLOC_NO_ZERO);
+
+	physical_get_frame(top_lvl)->flags |= FRAME_FLAG_PAGE_TABLE;
+	physical_get_frame(top_lvl)->owner = reinterpret_cast<uintptr_t>(this);
+
+	this->top_lvl_ = static_cast<PageTable*>(to_higher_half(top_lvl));
 	memset(this->top_lvl_, 0, sizeof(PageTable));
 
 	if(kernel_pagemap)
 	{
 		virt::pml3_translation = test_feature(FEATURE_HUGE_PAGE);
+		virt::pcid_translation = test_feature(FEATURE_PCID);
 
 		for(size_t i = 256; i < 512; i++)
 		{
@@ -143,8 +390,7 @@ void PageMap::initialize(bool kernel_pagemap)
 	}
 }
 
-void* PageMap::get_next_lvl(PageTableEntry& entry, bool allocate, uintptr_t virtual_address,
-							size_t old_page_size, size_t page_size)
+void* PageMap::get_next_lvl(PageTableEntry& entry, bool allocate, size_t old_page_size)
 {
 	void* ret = nullptr;
 
@@ -152,25 +398,38 @@ void* PageMap::get_next_lvl(PageTableEntry& entry, bool allocate, uintptr_t virt
 	{
 		if(entry.is_large() && (old_page_size != static_cast<size_t>(-1)))
 		{
-			size_t old_flags = this->vmm_flags(entry.get_flags(), old_page_size > PAGE_SIZE);
-			uintptr_t old_phys_address = entry.get_address();
-			uintptr_t old_virt_address = virtual_address & ~(old_page_size - 1);
+			// Lookups never split a large page, only mappings of a smaller size do.
+			if(!allocate)
+			{
+				return nullptr;
+			}
+
+			const size_t child_size = old_page_size / 512;
+			const uintptr_t old_phys_address = entry.get_address(old_page_size);
+			size_t child_flags = entry.get_flags();
 
-			if(old_phys_address & (old_page_size - 1))
+			// 4 KiB entries have no size bit and keep their PAT bit where large pages have PS.
+			if(child_size == PAGE_SIZE)
+			{
+				child_flags &= ~static_cast<size_t>(PAGE_FLAG_SIZE_EXTENSION);
+				child_flags |= (entry.val & PAGE_FLAG_LARGE_PAT) ? PAGE_FLAG_PAT : 0;
+			}
+			else
 			{
-				log_panik("Unexpected Page Table Entry Address: %p",
-						  reinterpret_cast<void*>(old_phys_address));
+				child_flags |= entry.val & PAGE_FLAG_LARGE_PAT;
 			}
 
-			ret = memory::physical_allocate();
-			entry.set_address(reinterpret_cast<uintptr_t>(ret));
-			entry.set_flags(NEW_PAGE_FLAGS);
+			ret = allocate_table(this);
+			PageTable* table = static_cast<PageTable*>(to_higher_half(ret));
 
-			for(size_t i = 0; i < old_page_size; i += page_size)
+			// The lock is already held by the caller, so the table is filled in directly.
+			for(size_t i = 0; i < 512; i++)
 			{
-				this->map_page(old_virt_address + i, old_phys_address + i,
-							   old_flags | get_page_size_flags(page_size));
+				table->entries[i].val = (old_phys_address + (i * child_size)) | child_flags;
 			}
+
+			physical_get_frame(ret)->entries = 512;
+			entry.store(reinterpret_cast<uintptr_t>(ret) | NEW_PAGE_FLAGS);
 		}
 		else
 		{
@@ -179,16 +438,15 @@ void* PageMap::get_next_lvl(PageTableEntry& entry, bool allocate, uintptr_t virt
 	}
 	else if(allocate)
 	{
-		ret = memory::physical_allocate();
-		entry.set_address(reinterpret_cast<uintptr_t>(ret));
-		entry.set_flags(NEW_PAGE_FLAGS);
+		ret = allocate_table(this);
+		set_entry(entry, reinterpret_cast<uintptr_t>(ret) | NEW_PAGE_FLAGS);
 	}
 
-	return memory::to_higher_half(ret);
+	return (ret == nullptr) ? nullptr : memory::to_higher_half(ret);
 }
 
 PageTableEntry* PageMap::virtual_to_entry(uintptr_t virtual_address, bool allocate,
-										  size_t page_size, bool check_large)
+										  size_t page_size, bool check_large, size_t* entry_size)
 {
 	const std::size_t pml5_entry = GET_PML_ENTRY(virtual_address, 48);
 	const std::size_t pml4_entry = GET_PML_ENTRY(virtual_address, 39);
@@ -224,51 +482,139 @@ PageTableEntry* PageMap::virtual_to_entry(uintptr_t virtual_address, bool alloca
 
 	if((page_size == PAGE_SIZE_1GiB) || (check_large && pdp->entries[pdp_entry].is_large()))
 	{
+		if(entry_size != nullptr)
+		{
+			*entry_size = PAGE_SIZE_1GiB;
+		}
+
 		return &pdp->entries[pdp_entry];
 	}
 
-	PageTable* pd = static_cast<PageTable*>(this->get_next_lvl(
-		pdp->entries[pdp_entry], allocate, virtual_address, PAGE_SIZE_1GiB, page_size));
+	PageTable* pd = static_cast<PageTable*>(
+		this->get_next_lvl(pdp->entries[pdp_entry], allocate, PAGE_SIZE_1GiB));
 
 	if(pd == nullptr)
 	{
 		return nullptr;
 	}
 
-	if((page_size == PAGE_SIZE_2MiB) || (check_large && pdp->entries[pd_entry].is_large()))
+	if((page_size == PAGE_SIZE_2MiB) || (check_large && pd->entries[pd_entry].is_large()))
 	{
+		if(entry_size != nullptr)
+		{
+			*entry_size = PAGE_SIZE_2MiB;
+		}
+
 		return &pd->entries[pd_entry];
 	}
 
-	PageTable* pt = static_cast<PageTable*>(this->get_next_lvl(
-		pd->entries[pd_entry], allocate, virtual_address, PAGE_SIZE_2MiB, page_size));
+	PageTable* pt = static_cast<PageTable*>(
+		this->get_next_lvl(pd->entries[pd_entry], allocate, PAGE_SIZE_2MiB));
 
 	if(pt == nullptr)
 	{
 		return nullptr;
 	}
 
+	if(entry_size != nullptr)
+	{
+		*entry_size = PAGE_SIZE;
+	}
+
 	return &pt->entries[pt_entry];
 }
 
-uintptr_t PageMap::virtual_to_physical(uintptr_t virtual_address, size_t flags)
+// Entries are read once each with acquire loads and tables are never freed under a walk, so
+// a lookup racing with a change sees the mapping from either before or after it.
+uintptr_t PageMap::walk_lockless(uintptr_t virtual_address, size_t& page_size)
 {
-	lock::ScopedLock guard(this->lock_);
+	PageTable* table = this->top_lvl_;
 
-	const size_t page_size = flag_to_page_size(flags);
-	PageTableEntry* pml_entry = this->virtual_to_entry(virtual_address, false, page_size, true);
+	if(table == nullptr)
+	{
+		return 0;
+	}
+
+	for(int level = top_level(); level > 0; level--)
+	{
+		const uintptr_t entry =
+			table->entries[GET_PML_ENTRY(virtual_address, 3 + (level * 9))].load();
+
+		if(!(entry & PAGE_FLAG_PRESENT))
+		{
+			return 0;
+		}
+
+		if((level == 1) || ((level <= 3) && (entry & PAGE_FLAG_SIZE_EXTENSION)))
+		{
+			page_size = level_page_size(level);
+			return entry;
+		}
 
-	if((pml_entry == nullptr) || !pml_entry->get_flags(PAGE_FLAG_PRESENT))
+		table = to_higher_half(reinterpret_cast<PageTable*>(entry & PAGE_ADDR_MASK));
+	}
+
+	return 0;
+}
+
+uintptr_t PageMap::virtual_to_physical(uintptr_t virtual_address)
+{
+	TableWalkGuard guard;
+	size_t page_size = 0;
+	PageTableEntry entry = {this->walk_lockless(virtual_address, page_size)};
+
+	if(!entry.is_valid())
 	{
 		return uintptr_t(-1);
 	}
 
-	return pml_entry->get_address() + (virtual_address % page_size);
+	return entry.get_address(page_size) + (virtual_address % page_size);
+}
+
+size_t PageMap::translate(uintptr_t virtual_address, size_t size, PhysicalSegment* segments,
+						  size_t max)
+{
+	TableWalkGuard guard;
+	const uintptr_t end = virtual_address + size;
+	size_t count = 0;
+
+	while(virtual_address < end)
+	{
+		size_t page_size = 0;
+		PageTableEntry entry = {this->walk_lockless(virtual_address, page_size)};
+
+		if(!entry.is_valid())
+		{
+			break;
+		}
+
+		const size_t offset = virtual_address % page_size;
+		const uintptr_t physical_address = entry.get_address(page_size) + offset;
+		const size_t chunk = std::min(page_size - offset, end - virtual_address);
+
+		if((count > 0) &&
+		   ((segments[count - 1].address + segments[count - 1].size) == physical_address))
+		{
+			segments[count - 1].size += chunk;
+		}
+		else if(count < max)
+		{
+			segments[count++] = {physical_address, chunk};
+		}
+		else
+		{
+			break;
+		}
+
+		virtual_address += chunk;
+	}
+
+	return count;
 }
 
 size_t PageMap::vmm_flags(size_t flags, bool large_pages)
 {
-	const uint64_t patbit = (large_pages ? (1 << 7) : (1 << 12));
+	const uint64_t patbit = (large_pages ? PAGE_FLAG_LARGE_PAT : PAGE_FLAG_PAT);
 	size_t ret = 0;
 
 	if(flags & PAGE_FLAG_PRESENT)
@@ -332,180 +678,598 @@ size_t PageMap::parse_flags(size_t flags)
 	return virt::parse_cache(flags, page_size) | virt::parse_flags(flags);
 }
 
+// The page variants are thin wrappers around the range operations, so they share their TLB
+// shootdowns. The page size in `flags` only sets the size of the range.
 error_t PageMap::map_page(uintptr_t virtual_address, uintptr_t physical_address, size_t flags)
 {
-	auto map_one = [this](uintptr_t virtual_address, uintptr_t physical_address, size_t flags,
-						  size_t page_size) {
-		PageTableEntry* pml_entry = this->virtual_to_entry(virtual_address, true, page_size, false);
+	return this->map_range(virtual_address, physical_address, flag_to_page_size(flags), flags);
+}
 
-		if(pml_entry == nullptr)
+error_t PageMap::unmap_page(uintptr_t virtual_address, size_t flags)
+{
+	const size_t page_size = flag_to_page_size(flags);
+	return this->unmap_range(align_down(virtual_address, page_size), page_size);
+}
+
+error_t PageMap::setflags_page(uintptr_t virtual_address, size_t flags)
+{
+	const size_t page_size = flag_to_page_size(flags);
+	return this->protect_range(align_down(virtual_address, page_size), page_size, flags);
+}
+
+error_t PageMap::remap_page(uintptr_t old_virtual_address, uintptr_t new_virtual_address,
+							size_t flags)
+{
+	return this->remap_pages(old_virtual_address, new_virtual_address, flag_to_page_size(flags),
+							 flags);
+}
+
+error_t PageMap::map_pages(uintptr_t virtual_address, uintptr_t physical_address, size_t size,
+						   size_t flags)
+{
+	return this->map_range(virtual_address, physical_address, size, flags);
+}
+
+error_t PageMap::unmap_pages(uintptr_t virtual_address, size_t size, size_t flags)
+{
+	const size_t page_size = flag_to_page_size(flags);
+	return this->unmap_range(align_down(virtual_address, page_size), align_up(size, page_size));
+}
+
+error_t PageMap::setflags_pages(uintptr_t virtual_address, size_t size, size_t flags)
+{
+	const size_t page_size = flag_to_page_size(flags);
+	return this->protect_range(align_down(virtual_address, page_size), align_up(size, page_size),
+							   flags);
+}
+
+// The new mapping is in place before the old one goes, so the frames stay reachable throughout.
+error_t PageMap::remap_pages(uintptr_t old_virtual_address, uintptr_t new_virtual_address,
+							 size_t size, size_t flags)
+{
+	const size_t page_size = flag_to_page_size(flags);
+
+	for(size_t i = 0; i < size; i += page_size)
+	{
+		const uintptr_t physical_address = this->virtual_to_physical(old_virtual_address + i);
+
+		if(physical_address == uintptr_t(-1))
 		{
-			log_error("Could not get pagemap entry for address 0x%.16lx", virtual_address);
 			return SYSTEM_ERR_ADDRESS_UNREACHABLE;
 		}
 
-		pml_entry->reset();
-		pml_entry->set_address(physical_address);
-		pml_entry->set_flags(flags);
+		const error_t ret =
+			this->map_range(new_virtual_address + i, physical_address, page_size, flags);
 
-		return SYSTEM_OK;
-	};
+		if(ret != SYSTEM_OK)
+		{
+			return ret;
+		}
+	}
 
-	lock::ScopedLock guard(this->lock_);
+	return this->unmap_range(old_virtual_address, size);
+}
 
-	const size_t page_size = flag_to_page_size(flags);
-	const size_t parsed_flags = this->parse_flags(flags);
+enum class RangeOperation
+{
+	MAP,
+	UNMAP,
+	PROTECT,
+	COLLAPSE,
+};
+
+struct PageMap::RangeWalk
+{
+	RangeOperation operation;
+	uintptr_t physical_address;
+	size_t flags;
+
+	uintptr_t invalidations[RANGE_INVALIDATE_BATCH];
+	size_t invalidation_count;
+	bool flush_all;
+	bool flush_global;
+
+	void* tables[RANGE_TABLE_BATCH];
+	size_t table_count;
+
+	// Other CPUs were asked to invalidate, finish() waits for them.
+	bool queued;
+	// The walk stopped at `resume` because the batch of unlinked tables is full.
+	bool stopped;
+	uintptr_t resume;
 
-	if((page_size == PAGE_SIZE_1GiB) && !virt::pml3_translation)
+	bool full() const
 	{
-		for(size_t i = 0; i < PAGE_SIZE_1GiB; i += PAGE_SIZE_2MiB)
+		return this->table_count >= (RANGE_TABLE_BATCH - RANGE_TABLE_RESERVE);
+	}
+
+	void invalidate(uintptr_t virtual_address, PageTableEntry& entry)
+	{
+		this->flush_global |= entry.get_flags(PAGE_FLAG_GLOBAL);
+
+		if(this->invalidation_count == RANGE_INVALIDATE_BATCH)
 		{
-			if(map_one(virtual_address + i, physical_address + i, parsed_flags, PAGE_SIZE_2MiB) !=
-			   SYSTEM_OK)
+			this->flush_all = true;
+			return;
+		}
+
+		this->invalidations[this->invalidation_count++] = virtual_address;
+	}
+
+	// Paging-structure caches may still point to the table until the flush. The ones of kernel
+	// addresses can be tagged with any PCID, so only a global flush drops all of them.
+	// A collapse replaces the entry with the large page that maps the same memory instead.
+	void unlink(uintptr_t virtual_address, PageTableEntry& entry, uintptr_t replacement = 0)
+	{
+		if(is_higher_half(virtual_address))
+		{
+			this->flush_all = true;
+			this->flush_global = true;
+		}
+
+		this->invalidate(virtual_address, entry);
+		this->tables[this->table_count++] = reinterpret_cast<void*>(entry.get_address());
+
+		set_entry(entry, replacement);
+	}
+
+	// Waits for the other CPUs to flush what was changed, then retires the tables nothing can
+	// reach anymore. CPUs spinning on a lock with interrupts disabled never take the shootdown
+	// IPI, so this runs after the page map lock is dropped.
+	void finish()
+	{
+		if(this->queued)
+		{
+			cpu::tlb::wait();
+		}
+
+		for(size_t i = 0; i < this->table_count; i++)
+		{
+			retire_table(this->tables[i], this->operation == RangeOperation::UNMAP);
+		}
+
+		this->invalidation_count = 0;
+		this->flush_all = false;
+		this->flush_global = false;
+		this->table_count = 0;
+		this->queued = false;
+	}
+
+	// Flushes this CPU and queues the flush on the others, with the page map lock held.
+	// Kernel mappings are global, so invlpg reaches them whatever PCID is loaded. Entries of
+	// another page map are dropped by PCID, or by giving the page map a fresh PCID.
+	void flush(PageMap* pagemap)
+	{
+		const bool pcid = cpu::read_cr4() & CR4_PCIDE;
+		const bool current =
+			(cpu::read_cr3() & PAGE_ADDR_MASK) ==
+			from_higher_half(reinterpret_cast<uintptr_t>(pagemap->top_lvl_));
+		bool drop = false;
+
+		if(!this->flush_all)
+		{
+			// A single invlpg drops the whole large page the address belongs to.
+			for(size_t i = 0; i < this->invalidation_count; i++)
 			{
-				return SYSTEM_ERR_ADDRESS_UNREACHABLE;
+				const uintptr_t address = this->invalidations[i];
+
+				if(current || is_higher_half(address))
+				{
+					cpu::invalidate_page(address);
+				}
+				else if(pcid && test_feature(FEATURE_INVPCID))
+				{
+					cpu::invpcid_va_pcid(address, pagemap->pcid_);
+				}
+				else
+				{
+					drop = pcid;
+				}
 			}
 		}
+		else if(this->flush_global)
+		{
+			cpu::x86_tlb_global_invalidate();
+		}
+		else if(current)
+		{
+			cpu::x86_tlb_nonglobal_invalidate(pcid ? pagemap->pcid_ : 0);
+		}
+		else
+		{
+			drop = pcid;
+		}
 
-		return SYSTEM_OK;
+		if(drop)
+		{
+			pagemap->drop_pcid();
+		}
+
+		this->shootdown(pagemap);
 	}
 
-	return map_one(virtual_address, physical_address, parsed_flags, page_size);
-}
+	// Kernel mappings are shared by every page map, so every CPU may cache them. Other entries
+	// are only cached by CPUs that have the page map loaded or still hold a flushed PCID of it.
+	void shootdown(PageMap* pagemap)
+	{
+		if(!cpu::smp::cpu_data_initialized() || (this->invalidation_count == 0))
+		{
+			return;
+		}
 
-error_t PageMap::unmap_page(uintptr_t virtual_address, size_t flags)
+		const cpu::smp::PlatformCpuData* self = cpu::smp::get_cpu_data();
+		const uintptr_t table = from_higher_half(reinterpret_cast<uintptr_t>(pagemap->top_lvl_));
+		const bool shared = is_higher_half(this->invalidations[0]);
+
+		{
+			// Taking the lock orders the table changes before the loads of the other CPUs.
+			lock::ScopedLock guard(virt::pcid_lock);
+
+			const bool pcid_valid = pagemap->pcid_generation_ == virt::pcid_generation;
+			const uint64_t bit = 1ul << (pagemap->pcid_ % 64);
+
+			for(size_t i = 0; i < cpu::smp::get_cpu_count(); i++)
+			{
+				const cpu::smp::PlatformCpuData* cpu_data = cpu::smp::get_cpu_data(i);
+
+				if((cpu_data == self) || !cpu_data->is_up)
+				{
+					continue;
+				}
+
+				const bool cached = pcid_valid &&
+									(cpu_data->pcid_generation == virt::pcid_generation) &&
+									(cpu_data->pcid_flushed[pagemap->pcid_ / 64] & bit);
+
+				if(!shared && (cpu_data->loaded_table != table) && !cached)
+				{
+					continue;
+				}
+
+				cpu::tlb::queue(i, this->invalidations, this->invalidation_count, pagemap->pcid_,
+								this->flush_all, this->flush_global || shared);
+				this->queued = true;
+			}
+		}
+	}
+};
+
+error_t PageMap::walk_range(RangeWalk& walk, PageTable* pml, int level, uintptr_t virtual_address,
+							uintptr_t end)
 {
-	auto unmap_one = [this](uintptr_t virtual_address, size_t page_size) {
-		PageTableEntry* pml_entry = this->virtual_to_entry(virtual_address, false, page_size, true);
+	const size_t entry_size = level_page_size(level);
+	const size_t old_page_size = (level <= 3) ? entry_size : static_cast<size_t>(-1);
+	const bool leaf_allowed = (level <= 2) || ((level == 3) && virt::pml3_translation);
+	const size_t leaf_flags = this->parse_flags(walk.flags | get_page_size_flags(entry_size));
+
+	while(virtual_address < end)
+	{
+		PageTableEntry& entry = pml->entries[GET_PML_ENTRY(virtual_address, 3 + (level * 9))];
+		const size_t chunk =
+			std::min(entry_size - (virtual_address & (entry_size - 1)), end - virtual_address);
+		const bool whole = (chunk == entry_size);
+		const bool leaf = (level == 1) || entry.is_large();
+		PageTable* next = nullptr;
+
+		if(walk.operation == RangeOperation::MAP)
+		{
+			// An existing table is reused instead of being replaced by a large page.
+			if(whole && leaf_allowed && is_aligned(walk.physical_address, entry_size) &&
+			   (!entry.is_valid() || leaf))
+			{
+				if(entry.is_valid())
+				{
+					walk.invalidate(virtual_address, entry);
+				}
 
-		if(pml_entry == nullptr)
+				set_entry(entry, walk.physical_address | leaf_flags);
+			}
+			else
+			{
+				next = static_cast<PageTable*>(this->get_next_lvl(entry, true, old_page_size));
+			}
+		}
+		else if(!entry.is_valid())
+		{
+			// Nothing is mapped here.
+		}
+		else if(leaf && whole)
+		{
+			const bool protect = (walk.operation == RangeOperation::PROTECT);
+			const uintptr_t physical_address = entry.get_address(entry_size);
+
+			walk.invalidate(virtual_address, entry);
+			set_entry(entry, protect ? (physical_address | leaf_flags) : 0);
+		}
+		else
+		{
+			// Part of a large page is changed, so it is split first.
+			next = static_cast<PageTable*>(this->get_next_lvl(entry, leaf, old_page_size));
+		}
+
+		if(next != nullptr)
+		{
+			const error_t ret =
+				this->walk_range(walk, next, level - 1, virtual_address, virtual_address + chunk);
+
+			if(ret != SYSTEM_OK)
+			{
+				return ret;
+			}
+
+			// Tables the top level points to stay, the kernel half of them is shared by every
+			// page map.
+			if((walk.operation == RangeOperation::UNMAP) && (level < top_level()) &&
+			   (physical_get_frame(from_higher_half(next))->entries == 0))
+			{
+				walk.unlink(virtual_address, entry);
+			}
+
+			if(walk.stopped)
+			{
+				return SYSTEM_OK;
+			}
+
+			// The tables can only be freed once the lock is dropped, start_walk resumes here.
+			if(walk.full())
+			{
+				walk.stopped = true;
+				walk.resume = virtual_address + chunk;
+
+				return SYSTEM_OK;
+			}
+		}
+		else if((walk.operation == RangeOperation::MAP) && !entry.is_valid())
 		{
 			log_error("Could not get pagemap entry for address 0x%.16lx", virtual_address);
 			return SYSTEM_ERR_ADDRESS_UNREACHABLE;
 		}
+		else if(walk.operation == RangeOperation::MAP)
+		{
+			walk.physical_address += chunk;
+		}
 
-		pml_entry->reset();
-		cpu::invalidate_page(virtual_address);
+		virtual_address += chunk;
+	}
 
-		return SYSTEM_OK;
-	};
+	return SYSTEM_OK;
+}
 
-	lock::ScopedLock guard(this->lock_);
-	const size_t page_size = flag_to_page_size(flags);
+error_t PageMap::start_walk(RangeWalk& walk, uintptr_t virtual_address, size_t size)
+{
+	uintptr_t start = align_down(virtual_address, PAGE_SIZE);
+	const uintptr_t end = align_up(virtual_address + size, PAGE_SIZE);
+	error_t ret = SYSTEM_OK;
 
-	if((page_size == PAGE_SIZE_1GiB) && !virt::pml3_translation)
+	do
 	{
-		for(size_t i = 0; i < PAGE_SIZE_1GiB; i += PAGE_SIZE_2MiB)
+		walk.stopped = false;
+
 		{
-			if(unmap_one(virtual_address + i, PAGE_SIZE_2MiB) != SYSTEM_OK)
+			lock::ScopedLock guard(this->lock_);
+
+			if(this->top_lvl_ == nullptr)
 			{
 				return SYSTEM_ERR_ADDRESS_UNREACHABLE;
 			}
+
+			ret = this->walk_range(walk, this->top_lvl_, top_level(), start, end);
+			walk.flush(this);
 		}
 
-		return SYSTEM_OK;
-	}
+		walk.finish();
+		start = walk.resume;
+	} while((ret == SYSTEM_OK) && walk.stopped && (start < end));
 
-	return unmap_one(virtual_address, page_size);
+	return ret;
 }
 
-error_t PageMap::setflags_page(uintptr_t virtual_address, size_t flags)
+error_t PageMap::map_range(uintptr_t virtual_address, uintptr_t physical_address, size_t size,
+						   size_t flags)
 {
-	lock::ScopedLock guard(this->lock_);
-
-	const size_t page_size = flag_to_page_size(flags);
-	const size_t parsed_flags = this->parse_flags(flags);
-	PageTableEntry* pml_entry = this->virtual_to_entry(virtual_address, true, page_size, true);
-
-	if(pml_entry == nullptr)
-	{
-		log_error("Could not get pagemap entry for address 0x%.16lx", virtual_address);
-		return SYSTEM_ERR_ADDRESS_UNREACHABLE;
-	}
+	RangeWalk walk = {};
+	walk.operation = RangeOperation::MAP;
+	walk.physical_address = align_down(physical_address, PAGE_SIZE);
+	walk.flags = flags & ~static_cast<size_t>(MAP_PAGE_2MB | MAP_PAGE_1GB);
 
-	uintptr_t physical_address = pml_entry->get_address();
+	return this->start_walk(walk, virtual_address, size);
+}
 
-	pml_entry->reset();
-	pml_entry->set_address(physical_address);
-	pml_entry->set_flags(parsed_flags);
+error_t PageMap::unmap_range(uintptr_t virtual_address, size_t size)
+{
+	RangeWalk walk = {};
+	walk.operation = RangeOperation::UNMAP;
 
-	return SYSTEM_OK;
+	return this->start_walk(walk, virtual_address, size);
 }
 
-error_t PageMap::remap_page(uintptr_t old_virtual_address, uintptr_t new_virtual_address,
-							size_t flags)
+error_t PageMap::protect_range(uintptr_t virtual_address, size_t size, size_t flags)
 {
-	uintptr_t physical_address = this->virtual_to_physical(old_virtual_address, flags);
-	this->unmap_page(old_virtual_address, flags);
-	return this->map_page(new_virtual_address, physical_address, flags);
+	RangeWalk walk = {};
+	walk.operation = RangeOperation::PROTECT;
+	walk.flags = flags & ~static_cast<size_t>(MAP_PAGE_2MB | MAP_PAGE_1GB);
+
+	return this->start_walk(walk, virtual_address, size);
 }
 
-error_t PageMap::map_pages(uintptr_t virtual_address, uintptr_t physical_address, size_t size,
-						   size_t flags)
+// Returns the large entry mapping what the entries of a table at `level` map, or 0 if they
+// differ in more than their address, accessed and dirty bits.
+static uintptr_t collapsed_entry(PageTable* table, int level)
 {
-	const size_t page_size = flag_to_page_size(flags);
+	const size_t page_size = level_page_size(level);
+	const uintptr_t address_mask = PAGE_ADDR_MASK & ~(page_size - 1);
+	const uintptr_t ignored = address_mask | PAGE_FLAG_ACCESSED | PAGE_FLAG_DIRTY;
+	const uintptr_t first = table->entries[0].load();
+	const uintptr_t base = first & address_mask;
+	const uintptr_t flags = first & ~ignored;
+
+	// Entries of a page directory have to be large pages themselves.
+	if(!(first & PAGE_FLAG_PRESENT) || !is_aligned(base, page_size * 512) ||
+	   ((level == 2) && !(first & PAGE_FLAG_SIZE_EXTENSION)))
+	{
+		return 0;
+	}
 
-	for(size_t i = 0; i < size; i += page_size)
+	for(size_t i = 1; i < 512; i++)
 	{
-		if(this->map_page(virtual_address + i, physical_address + i, flags) != SYSTEM_OK)
+		const uintptr_t entry = table->entries[i].load();
+
+		if(((entry & address_mask) != (base + (i * page_size))) || ((entry & ~ignored) != flags))
 		{
-			this->unmap_pages(virtual_address, i - page_size, flags);
-			return SYSTEM_ERR_ADDRESS_UNREACHABLE;
+			return 0;
 		}
 	}
 
-	return SYSTEM_OK;
+	if(level == 2)
+	{
+		return base | flags;
+	}
+
+	// The PAT bit of a 4 KiB page moves to where large pages keep it.
+	return base | (flags & ~static_cast<uintptr_t>(PAGE_FLAG_PAT)) | PAGE_FLAG_SIZE_EXTENSION |
+		   ((flags & PAGE_FLAG_PAT) ? PAGE_FLAG_LARGE_PAT : 0);
 }
 
-error_t PageMap::unmap_pages(uintptr_t virtual_address, size_t size, size_t flags)
+// Tables are collapsed bottom up, so a directory whose tables all became 2 MiB pages can turn
+// into a 1 GiB page in the same pass.
+size_t PageMap::collapse_level(RangeWalk& walk, PageTable* pml, int level,
+							   uintptr_t virtual_address)
 {
-	const size_t page_size = flag_to_page_size(flags);
+	const size_t entry_size = level_page_size(level);
+	const bool collapsible = (level == 2) || ((level == 3) && virt::pml3_translation);
+	size_t ret = 0;
 
-	for(size_t i = 0; i < size; i += page_size)
+	for(size_t i = 0; i < 512; i++, virtual_address += entry_size)
 	{
-		if(this->unmap_page(virtual_address + i, flags) != SYSTEM_OK)
+		PageTableEntry& entry = pml->entries[i];
+
+		if((level == 1) || !entry.is_valid() || ((level <= 3) && entry.is_large()))
 		{
-			return SYSTEM_ERR_ADDRESS_UNREACHABLE;
+			continue;
 		}
-	}
 
-	return SYSTEM_OK;
-}
+		PageTable* next = to_higher_half(reinterpret_cast<PageTable*>(entry.get_address()));
+		ret += this->collapse_level(walk, next, level - 1, virtual_address);
 
-error_t PageMap::setflags_pages(uintptr_t virtual_address, size_t size, size_t flags)
-{
-	const size_t page_size = flag_to_page_size(flags);
+		if(walk.stopped)
+		{
+			return ret;
+		}
 
-	for(size_t i = 0; i < size; i += page_size)
-	{
-		if(this->setflags_page(virtual_address + i, flags) != SYSTEM_OK)
+		const uintptr_t large = collapsible ? collapsed_entry(next, level - 1) : 0;
+
+		if(large == 0)
 		{
-			return SYSTEM_ERR_ADDRESS_UNREACHABLE;
+			continue;
+		}
+
+		walk.unlink(virtual_address, entry, large);
+		ret++;
+
+		if(walk.full())
+		{
+			walk.stopped = true;
+			return ret;
 		}
 	}
 
-	return SYSTEM_OK;
+	return ret;
 }
 
-error_t PageMap::remap_pages(uintptr_t old_virtual_address, uintptr_t new_virtual_address,
-							 size_t size, size_t flags)
+// A pass stops once the batch of unlinked tables is full, and is started over after retiring
+// them. Collapsed tables are large pages by then, so every pass gets further.
+size_t PageMap::collapse_range(uintptr_t virtual_address, size_t size)
 {
-	const size_t page_size = flag_to_page_size(flags);
+	if(size == 0)
+	{
+		return 0;
+	}
 
-	for(size_t i = 0; i < size; i += page_size)
+	RangeWalk walk = {};
+	walk.operation = RangeOperation::COLLAPSE;
+
+	// The last address is used instead of the end, which wraps to 0 for the last entry.
+	const int level = top_level();
+	const size_t entry_size = level_page_size(level);
+	const uintptr_t last = virtual_address + size - 1;
+	size_t ret = 0;
+
+	do
 	{
-		if(this->remap_page(old_virtual_address + i, new_virtual_address + i, flags) != SYSTEM_OK)
+		walk.stopped = false;
+
 		{
-			return SYSTEM_ERR_ADDRESS_UNREACHABLE;
+			lock::ScopedLock guard(this->lock_);
+
+			if(this->top_lvl_ == nullptr)
+			{
+				return ret;
+			}
+
+			for(uintptr_t address = align_down(virtual_address, entry_size); !walk.stopped;)
+			{
+				PageTableEntry& entry =
+					this->top_lvl_->entries[GET_PML_ENTRY(address, 3 + (level * 9))];
+
+				if(entry.is_valid())
+				{
+					ret += this->collapse_level(
+						walk, to_higher_half(reinterpret_cast<PageTable*>(entry.get_address())),
+						level - 1, address);
+				}
+
+				if((last - address) < entry_size)
+				{
+					break;
+				}
+
+				address += entry_size;
+			}
+
+			walk.flush(this);
 		}
-	}
 
-	return SYSTEM_OK;
+		walk.finish();
+	} while(walk.stopped);
+
+	return ret;
 }
 
-void PageMap::load()
+void PageMap::load(bool flush)
 {
-	cpu::write_cr3(from_higher_half(reinterpret_cast<uintptr_t>(this->top_lvl_)));
+	const uintptr_t table = from_higher_half(reinterpret_cast<uintptr_t>(this->top_lvl_));
+
+	if(!cpu::smp::cpu_data_initialized())
+	{
+		cpu::write_cr3(table);
+		return;
+	}
+
+	// A shootdown interrupting the switch could see the table as loaded without its PCID.
+	cpu::smp::PlatformCpuData* cpu_data = cpu::smp::get_cpu_data();
+	const bool interrupts = arch::interrupt_status();
+	disable_interrupts();
+
+	// Published before the switch, so a shootdown that misses it changed the tables before.
+	cpu_data->loaded_table = table;
+
+	// PCIDs are only turned on once the per-CPU data is reachable.
+	if(!(cpu::read_cr4() & CR4_PCIDE))
+	{
+		cpu::write_cr3(table);
+	}
+	else
+	{
+		bool stale = false;
+		const uint16_t pcid = this->get_pcid(stale);
+
+		cpu::write_cr3(table | pcid | ((flush || stale) ? 0 : CR3_NOFLUSH));
+	}
+
+	if(interrupts)
+	{
+		enable_interrupts();
+	}
 }
 
 void PageMap::save()
@@ -522,6 +1286,12 @@ void PageMap::destroy_level(PageTable* pml, int start, int end, int level)
 
 	for(size_t i = start; i < end; i++)
 	{
+		// Entries of the last level and large pages point to memory, not to tables.
+		if((level == 1) || pml->entries[i].is_large())
+		{
+			continue;
+		}
+
 		PageTable* next = static_cast<PageTable*>(this->get_next_lvl(pml->entries[i], false));
 
 		if(next == nullptr)
@@ -532,6 +1302,142 @@ void PageMap::destroy_level(PageTable* pml, int start, int end, int level)
 		destroy_level(next, 0, 512, level - 1);
 	}
 
-	physical_free(from_higher_half(this->top_lvl_));
+	retire_table(from_higher_half(pml));
+}
+
+uint16_t PageMap::get_pcid(bool& flush)
+{
+	cpu::smp::PlatformCpuData* cpu_data = cpu::smp::get_cpu_data();
+	lock::ScopedLock guard(virt::pcid_lock);
+
+	if(this->pcid_generation_ != virt::pcid_generation)
+	{
+		if(virt::pcid_next == PCID_COUNT)
+		{
+			virt::pcid_generation++;
+			virt::pcid_next = 1;
+		}
+
+		this->pcid_ = virt::pcid_next++;
+		this->pcid_generation_ = virt::pcid_generation;
+	}
+
+	if(cpu_data->pcid_generation != virt::pcid_generation)
+	{
+		memset(cpu_data->pcid_flushed, 0, sizeof(cpu_data->pcid_flushed));
+		cpu_data->pcid_generation = virt::pcid_generation;
+	}
+
+	// The PCID may still tag entries of a previous owner on this CPU until it is flushed here.
+	uint64_t& word = cpu_data->pcid_flushed[this->pcid_ / 64];
+	const uint64_t bit = 1ul << (this->pcid_ % 64);
+
+	flush = !(word & bit);
+	word |= bit;
+
+	return this->pcid_;
+}
+
+void PageMap::drop_pcid()
+{
+	lock::ScopedLock guard(virt::pcid_lock);
+	this->pcid_generation_ = 0;
+}
+
+void paging_initialize_cpu()
+{
+	cpu::write_cr4(cpu::read_cr4() | CR4_PGE);
+
+	// Tables loaded before the per-CPU data was reachable weren't recorded.
+	cpu::smp::get_cpu_data()->loaded_table = cpu::read_cr3() & PAGE_ADDR_MASK;
+
+	// PCIDE can only be set while CR3 holds PCID 0, which it does until the next load().
+	if(virt::pcid_translation)
+	{
+		cpu::write_cr4(cpu::read_cr4() | CR4_PCIDE);
+	}
+}
+
+bool paging_collapse_step()
+{
+	const size_t now = drivers::timers::get_time();
+
+	if((now < virt::collapse_next_run) || !virt::collapse_lock.try_lock())
+	{
+		return false;
+	}
+
+	virt::collapse_next_run = now + COLLAPSE_INTERVAL_MS;
+
+	// Canonical kernel addresses of the top level entry, the sign extension fills the rest.
+	const int shift = 3 + (top_level() * 9);
+	const uintptr_t address = (~0ul << (shift + 8)) | (virt::collapse_slot << shift);
+	const size_t collapsed = base_pagemap.collapse_range(address, 1ul << shift);
+
+	virt::collapse_slot = (virt::collapse_slot == 511) ? 256 : (virt::collapse_slot + 1);
+	virt::collapsed_tables += collapsed;
+
+	virt::collapse_lock.unlock();
+
+	if(collapsed != 0)
+	{
+		log_debug("Collapsed %lu page tables into large pages", collapsed);
+	}
+
+	return true;
+}
+
+size_t paging_collapsed_tables()
+{
+	return __atomic_load_n(&virt::collapsed_tables, __ATOMIC_RELAXED);
+}
+
+void paging_benchmark_switch()
+{
+	if(!virt::pcid_translation)
+	{
+		log_info("Address space switch benchmark skipped, PCIDs are not supported");
+		return;
+	}
+
+	const size_t size = SWITCH_BENCHMARK_PAGES * PAGE_SIZE;
+	void* frames = physical_allocate(SWITCH_BENCHMARK_PAGES);
+	uint64_t cycles[2] = {};
+
+	{
+		PageMap pagemaps[2];
+
+		for(PageMap& pagemap : pagemaps)
+		{
+			pagemap.initialize();
+			pagemap.map_range(SWITCH_BENCHMARK_ADDRESS, reinterpret_cast<uintptr_t>(frames), size,
+							  MAP_READ | MAP_WRITE | MAP_WRITE_BACK);
+		}
+
+		// Every round switches and touches each page, which misses the TLB after a flush.
+		for(size_t flush = 0; flush < 2; flush++)
+		{
+			const uint64_t start_time = cpu::read_tsc();
+
+			for(size_t i = 0; i < SWITCH_BENCHMARK_ROUNDS; i++)
+			{
+				pagemaps[i % 2].load(flush);
+
+				for(size_t j = 0; j < size; j += PAGE_SIZE)
+				{
+					*reinterpret_cast<volatile uint64_t*>(SWITCH_BENCHMARK_ADDRESS + j);
+				}
+			}
+
+			cycles[flush] = (cpu::read_tsc() - start_time) / SWITCH_BENCHMARK_ROUNDS;
+		}
+
+		base_pagemap.load();
+	}
+
+	physical_free(frames, SWITCH_BENCHMARK_PAGES);
+
+	log_info("Address space switch touching %d pages: %lu cycles with PCIDs, %lu without",
+			 SWITCH_BENCHMARK_PAGES, cycles[0], cycles[1]);
 }
 } // namespace memory
\ No newline at end of file
@@ -5,12 +5,56 @@
 #include "kernel.h"
 #include "lock.hpp"
 #include "logger.h"
+#include <memory/heap.hpp>
+#include <memory/paging.hpp>
+#include <memory/physical.hpp>
 
 namespace cpu
 {
 namespace smp
 {
 PlatformCpuData* cpu_datas = nullptr;
+bool cpu_datas_initialized = false;
+
+PlatformCpuData* get_cpu_data(size_t id)
+{
+	return &cpu_datas[id];
+}
+
+size_t get_cpu_count()
+{
+	return boot_info.cpu_count;
+}
+
+bool cpu_data_initialized()
+{
+	return cpu_datas_initialized;
+}
+
+void idle()
+{
+	while(true)
+	{
+		if(memory::physical_refill_zero_pool() || memory::paging_collapse_step() ||
+		   memory::heap_idle_work())
+		{
+			continue;
+		}
+
+		// APs have no timer, so a wake-up IPI that lands between the checks above and the HLT
+		// would leave the CPU asleep with work pending. Check again with interrupts disabled
+		// and only enable them together with the HLT.
+		disable_interrupts();
+
+		if(memory::heap_idle_pending())
+		{
+			enable_interrupts();
+			continue;
+		}
+
+		enable_interrupts_and_hlt();
+	}
+}
 
 void cpu_entry(limine_smp_info* cpu)
 {
@@ -21,34 +65,46 @@ void cpu_entry(limine_smp_info* cpu)
 		initialize_cpu(cpu);
 
 		log_debug("CPU %lu is up.", get_cpu_data()->id);
+
+		// The bootloader's stack stays in use, keep it from being reclaimed.
+		get_cpu_data()->boot_stack = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
 		get_cpu_data()->is_up = true;
 	}
 
-	if(get_cpu_data()->local_apic_id != smp_request.response->bsp_lapic_id)
+	if(get_cpu_data()->local_apic_id != boot_info.bsp_lapic_id)
 	{
 		log_debug("Hello");
+
+		// Shootdown IPIs have to reach idle CPUs.
+		enable_interrupts();
+		idle();
 	}
 }
 
 void initialize_bsp()
 {
-	cpu_datas = new PlatformCpuData[smp_request.response->cpu_count];
+	cpu_datas = new PlatformCpuData[smp_request.response->cpu_count]();
 
 	for(size_t i = 0; i < smp_request.response->cpu_count; i++)
 	{
 		limine_smp_info* smp_info = smp_request.response->cpus[i];
 
+		// Needed early to assign every CPU to its NUMA node.
+		cpu_datas[i].local_apic_id = static_cast<int>(get_apic_id(smp_info));
+		cpu_datas[i].id = i;
+
 		if(get_apic_id(smp_info) != smp_request.response->bsp_lapic_id)
 		{
 			continue;
 		}
 
-		cpu_datas[i].local_apic_id = get_apic_id(smp_info);
-		cpu_datas[i].id = i;
 		smp_info->extra_argument = reinterpret_cast<uintptr_t>(&cpu_datas[i]);
 
 		initialize_base_cpu(smp_info);
 	}
+
+	// GS now points at the BSP's data. APs set up their GS base before they allocate anything.
+	cpu_datas_initialized = true;
 }
 
 void initialize()
@@ -58,6 +114,7 @@ void initialize()
 		limine_smp_info* smp_info = smp_request.response->cpus[i];
 		smp_info->extra_argument = reinterpret_cast<uintptr_t>(&cpu_datas[i]);
 		cpu_datas[i].id = i;
+		cpu_datas[i].local_apic_id = get_apic_id(smp_info);
 
 		if(cpu_datas[i].local_apic_id != smp_request.response->bsp_lapic_id)
 		{
@@ -65,7 +122,7 @@ void initialize()
 
 			while(!cpu_datas[i].is_up)
 			{
-				arch::halt();
+				pause();
 			}
 		}
 		else
@@ -9,12 +9,20 @@
 #include <uacpi/event.h>
 
 #define MADT_SIGNATURE "APIC"
+#define SRAT_SIGNATURE "SRAT"
+#define SLIT_SIGNATURE "SLIT"
+
+// Distances defined by the ACPI specification when there is no SLIT.
+#define LOCAL_DISTANCE 10
+#define REMOTE_DISTANCE 20
 
 namespace drivers
 {
 namespace acpi
 {
 acpi_madt* madt_header = nullptr;
+acpi_srat* srat_header = nullptr;
+acpi_slit* slit_header = nullptr;
 
 bool legacy_pic() {
 	return madt_header && madt_header->flags & 1;
@@ -33,6 +41,73 @@ void initialize_madt()
 	madt_header = reinterpret_cast<acpi_madt*>(out_table.virt_addr);
 }
 
+void initialize_srat()
+{
+	uacpi_table out_table = {};
+
+	// Both tables are optional, without them every CPU and all memory is in one node.
+	if(uacpi_table_find_by_signature(SRAT_SIGNATURE, &out_table) == UACPI_STATUS_OK)
+	{
+		srat_header = reinterpret_cast<acpi_srat*>(out_table.virt_addr);
+	}
+
+	if(uacpi_table_find_by_signature(SLIT_SIGNATURE, &out_table) == UACPI_STATUS_OK)
+	{
+		slit_header = reinterpret_cast<acpi_slit*>(out_table.virt_addr);
+	}
+}
+
+template<typename T>
+static void get_srat_entries(uint8_t type, std::vector<T>& entries)
+{
+	if(srat_header == nullptr)
+	{
+		return;
+	}
+
+	uintptr_t start = reinterpret_cast<uintptr_t>(srat_header->entries);
+	uintptr_t end = reinterpret_cast<uintptr_t>(srat_header) + srat_header->hdr.length;
+
+	acpi_entry_hdr* srat = reinterpret_cast<acpi_entry_hdr*>(start);
+
+	for(uintptr_t entry = start; entry < end;
+		entry += srat->length, srat = reinterpret_cast<acpi_entry_hdr*>(entry))
+	{
+		if(srat->type == type)
+		{
+			entries.push_back(*reinterpret_cast<T*>(entry));
+		}
+	}
+
+	entries.shrink_to_fit();
+}
+
+void get_memory_affinities(std::vector<acpi_srat_memory_affinity>& affinities)
+{
+	get_srat_entries(ACPI_SRAT_ENTRY_TYPE_MEMORY_AFFINITY, affinities);
+}
+
+void get_processor_affinities(std::vector<acpi_srat_processor_affinity>& affinities)
+{
+	get_srat_entries(ACPI_SRAT_ENTRY_TYPE_PROCESSOR_AFFINITY, affinities);
+}
+
+void get_x2apic_affinities(std::vector<acpi_srat_x2apic_affinity>& affinities)
+{
+	get_srat_entries(ACPI_SRAT_ENTRY_TYPE_X2APIC_AFFINITY, affinities);
+}
+
+uint8_t get_locality_distance(uint32_t from, uint32_t to)
+{
+	if((slit_header == nullptr) || (from >= slit_header->num_localities) ||
+	   (to >= slit_header->num_localities))
+	{
+		return (from == to) ? LOCAL_DISTANCE : REMOTE_DISTANCE;
+	}
+
+	return slit_header->matrix[(from * slit_header->num_localities) + to];
+}
+
 void get_io_apic(std::vector<acpi_madt_ioapic>& ioapics)
 {
 	uintptr_t start = reinterpret_cast<uintptr_t>(madt_header->entries);
@@ -102,6 +177,7 @@ void initialize()
 	}
 
 	initialize_madt();
+	initialize_srat();
 
 	log_end_intialization();
 }
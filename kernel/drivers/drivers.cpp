@@ -1,5 +1,6 @@
 #include "drivers/acpi.hpp"
 #include <drivers/drivers.hpp>
+#include <memory/physical.hpp>
 
 namespace drivers
 {
@@ -13,5 +14,8 @@ void initialize()
 {
 	arch_initialize();
 	acpi::initialize();
+
+	// Memory affinity is only known once the ACPI tables are available.
+	memory::physical_initialize_nodes();
 }
 } // namespace drivers
\ No newline at end of file
@@ -4,26 +4,17 @@
 #include <uacpi/kernel_api.h>
 
 #include <memory/memory.hpp>
-#include <memory/virtual.hpp>
+#include <memory/io_map.hpp>
 #include <memory/heap.hpp>
 
 void* uacpi_kernel_map(uacpi_phys_addr addr, uacpi_size len)
 {
-	uintptr_t physical_addr = memory::align_down(addr, PAGE_SIZE);
-	size_t count = memory::div_roundup((addr - physical_addr) + len, PAGE_SIZE);
-
-	void* virt_addr = memory::virtual_allocate_at(physical_addr, count, MAP_WRITE | MAP_READ);
-
-	return reinterpret_cast<uint8_t*>(virt_addr) + (addr - physical_addr);
+	return memory::io_map(addr, len);
 }
 
 void uacpi_kernel_unmap(void* addr, uacpi_size len)
 {
-	uintptr_t address = reinterpret_cast<uintptr_t>(addr);
-	uintptr_t virt_base = memory::align_down(address, PAGE_SIZE);
-	size_t count = memory::div_roundup((address - virt_base) + len, PAGE_SIZE);
-
-	memory::virtual_free_at(reinterpret_cast<void*>(virt_base), count);
+	memory::io_unmap(addr, len);
 }
 
 void* uacpi_kernel_alloc(uacpi_size size)
@@ -9,6 +9,8 @@
 #define disable_interrupts() asm volatile("cli")
 #define enable_interrupts() asm volatile("sti")
 #define hlt() asm volatile("hlt")
+// STI only takes effect after the next instruction, so no interrupt can arrive before the HLT.
+#define enable_interrupts_and_hlt() asm volatile("sti; hlt" ::: "memory")
 
 namespace arch
 {
@@ -6,8 +6,13 @@
 
 #include <cpu/gdt.hpp>
 #include <cpu/idt.hpp>
+#include <cpu/tlb.hpp>
 
 #include <kernel.h>
+#include <mmu.hpp>
+
+#include <memory/heap.hpp>
+#include <memory/physical.hpp>
 
 namespace cpu
 {
@@ -18,7 +23,8 @@ struct ApicContext
 	size_t apic_ticks_per_ms = 0;
 };
 
-struct PlatformCpuData
+// Every CPU's data starts on a cache line of its own.
+struct __ALIGNED(CACHE_LINE_SIZE) PlatformCpuData
 {
 	size_t id;
 	PlatformCpuData* self;
@@ -28,6 +34,24 @@ struct PlatformCpuData
 	interrupts::IdtTable* idt;
 	gdt::Tss* tss;
 
+	memory::FrameCache frame_cache;
+	memory::HeapCache heap_cache;
+	memory::PhysicalCpuStats phys_telemetry;
+	size_t numa_node;
+	uintptr_t boot_stack;
+
+	// PCIDs this CPU flushed since the current PCID generation started.
+	uint64_t pcid_generation;
+	uint64_t pcid_flushed[PCID_COUNT / 64];
+	// Top level table in CR3, other CPUs only interrupt this one for page maps it may cache.
+	uintptr_t loaded_table;
+	tlb::Mailbox tlb_mailbox;
+	// Zeroed frames for new page tables, refilled from the PMM in one batch.
+	void* page_table_cache[PAGE_TABLE_CACHE_SIZE];
+	size_t page_table_cache_count;
+	// Epoch of the lockless page table walk running on this CPU, 0 when there is none.
+	std::atomic<uint64_t> table_walk_epoch;
+
 	bool is_up;
 };
 
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <cpu/features.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <cpu/registers.h>
 
 #define PAT_FORCE_UNCACHABLE 0x0ul
@@ -211,6 +212,49 @@ inline void fxrstor(uint8_t* region)
 	asm volatile("fxrstorq (%0)" ::"r"(region), "a"(RFBM_LOW), "d"(RFBM_HIGH) : "memory");
 }
 
+/**
+ * @brief Reads the time-stamp counter.
+ *
+ * @return The current value of the time-stamp counter.
+ */
+inline uint64_t read_tsc()
+{
+	uint32_t low = 0;
+	uint32_t high = 0;
+
+	asm volatile("rdtsc" : "=a"(low), "=d"(high));
+
+	return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+/**
+ * @brief Zeroes memory with non-temporal stores, so it does not displace cached data.
+ *
+ * @param address Start of the memory, aligned to 8 bytes.
+ * @param size Number of bytes to zero, a multiple of 64.
+ */
+inline void zero_nontemporal(void* address, size_t size)
+{
+	uint64_t* ptr = static_cast<uint64_t*>(address);
+
+	for(size_t i = 0; i < (size / sizeof(uint64_t)); i += 8)
+	{
+		asm volatile("movnti %1, 0x00(%0)\n"
+					 "movnti %1, 0x08(%0)\n"
+					 "movnti %1, 0x10(%0)\n"
+					 "movnti %1, 0x18(%0)\n"
+					 "movnti %1, 0x20(%0)\n"
+					 "movnti %1, 0x28(%0)\n"
+					 "movnti %1, 0x30(%0)\n"
+					 "movnti %1, 0x38(%0)\n" ::"r"(ptr + i),
+					 "r"(0ull)
+					 : "memory");
+	}
+
+	// Non-temporal stores are weakly ordered, make them visible before the memory is handed out.
+	asm volatile("sfence" ::: "memory");
+}
+
 /**
  * @brief Reads the base address of the kernel GS segment.
  *
@@ -111,6 +111,7 @@ struct CpuidBit
 #define FEATURE_SSBD CPUID_BIT(CPUID_EXTENDED_FEATURE_FLAGS, 3, 31)
 
 #define FEATURE_AMD_TOPO CPUID_BIT(CPUID_FEATS, 2, 22)
+#define FEATURE_PERFCTR_CORE CPUID_BIT(CPUID_FEATS, 2, 23)
 #define FEATURE_SYSCALL CPUID_BIT(CPUID_FEATS, 3, 11)
 #define FEATURE_NX CPUID_BIT(CPUID_FEATS, 3, 20)
 #define FEATURE_HUGE_PAGE CPUID_BIT(CPUID_FEATS, 3, 26)
@@ -59,6 +59,7 @@
 #define INTERRUPT_IPI_RESCHEDULE (245)
 #define INTERRUPT_IPI_INTERRUPT (246)
 #define INTERRUPT_IPI_HALT (247)
+#define INTERRUPT_IPI_TLB_SHOOTDOWN (248)
 
 #define IDT_INTERRUPT_GATE 0xe
 #define IDT_TRAP_GATE 0xf
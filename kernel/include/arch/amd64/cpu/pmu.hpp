@@ -0,0 +1,25 @@
+#ifndef CPU_PMU_HPP
+#define CPU_PMU_HPP 1
+
+#include <stdint.h>
+
+namespace cpu
+{
+namespace pmu
+{
+enum class Event
+{
+	// Loads that missed the first level data TLB and needed a page walk.
+	DTLB_LOAD_MISS,
+};
+
+// Counts `event` in kernel mode with the first general purpose counter of the calling CPU,
+// starting from zero. Returns false if the CPU has no counter for it, e.g. under a hypervisor
+// that doesn't expose the PMU.
+bool start(Event __event);
+uint64_t read();
+void stop();
+} // namespace pmu
+} // namespace cpu
+
+#endif // CPU_PMU_HPP
@@ -90,11 +90,13 @@
 #define MSR_TSX_CTRL 0x00000122 /* Control to enable/disable TSX instructions */
 #define TSX_CTRL_RTM_DISABLE (1ull << 0) /* Force all RTM instructions to abort */
 #define TSX_CTRL_CPUID_DISABLE (1ull << 1) /* Mask RTM and HLE in CPUID */
+#define MSR_PMC0 0x000000c1 /* general purpose performance counter 0 */
 #define MSR_SYSENTER_CS 0x00000174 /* SYSENTER CS */
 #define MSR_SYSENTER_ESP 0x00000175 /* SYSENTER ESP */
 #define MSR_SYSENTER_EIP 0x00000176 /* SYSENTER EIP */
 #define MSR_MCG_CAP 0x00000179 /* global machine check capability */
 #define MSR_MCG_STATUS 0x0000017a /* global machine check status */
+#define MSR_PERFEVTSEL0 0x00000186 /* performance event select 0 */
 #define MSR_MISC_ENABLE 0x000001a0 /* enable/disable misc processor features */
 #define MSR_MISC_ENABLE_TURBO_DISABLE (1ull << 38)
 #define MSR_TEMPERATURE_TARGET 0x000001a2 /* Temperature target */
@@ -168,6 +170,7 @@
 #define MSR_GS_BASE 0xc0000101 /* gs base address */
 #define MSR_KERNEL_GS_BASE 0xc0000102 /* kernel gs base */
 #define MSR_TSC_AUX 0xc0000103 /* TSC aux */
+#define MSR_PERF_GLOBAL_CTRL 0x0000038f /* global performance counter control */
 #define MSR_PM_ENABLE 0x00000770 /* enable/disable HWP */
 #define MSR_HWP_CAPABILITIES 0x00000771 /* HWP performance range enumeration */
 #define MSR_HWP_REQUEST 0x00000774 /* power manage control hints */
@@ -201,6 +204,8 @@
 #define AMD_LS_CFG_F17H_SSBD (1ull << 10)
 #define MSR_K7_HWCR 0xc0010015 /* AMD Hardware Configuration */
 #define MSR_K7_HWCR_CPB_DISABLE (1ull << 25) /* Set to disable turbo ('boost') */
+#define MSR_AMD_PERF_CTL0 0xc0010200 /* AMD core performance event select 0 */
+#define MSR_AMD_PERF_CTR0 0xc0010201 /* AMD core performance counter 0 */
 
 // KVM MSRs
 #define MSR_KVM_PV_EOI_EN 0x4b564d04 /* Enable paravirtual fast APIC EOI */
@@ -0,0 +1,60 @@
+#ifndef CPU_TLB_HPP
+#define CPU_TLB_HPP 1
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <lock.hpp>
+
+// Addresses a CPU collects before a shootdown turns into a full flush.
+#define TLB_SHOOTDOWN_BATCH 32
+
+namespace cpu
+{
+namespace tlb
+{
+// Invalidations other CPUs queued for one CPU. Everything queued while an IPI is pending is
+// handled by that IPI, so a burst of requests costs the target a single interrupt.
+struct Mailbox
+{
+	lock::mutex lock;
+
+	uintptr_t addresses[TLB_SHOOTDOWN_BATCH];
+	uint16_t pcids[TLB_SHOOTDOWN_BATCH];
+	size_t count;
+	bool flush_all;
+	bool flush_global;
+	bool ipi_pending;
+
+	// Every request gets a sequence number, the CPU publishes the last one it handled.
+	uint64_t requested;
+	std::atomic<uint64_t> completed;
+};
+
+// A batch is everything a CPU handled at once, so pages_invalidated / batches_handled is the
+// average number of pages a shootdown IPI covered.
+struct ShootdownStats
+{
+	size_t ipis_sent;
+	size_t batches_handled;
+	size_t pages_invalidated;
+	size_t full_flushes;
+};
+
+void initialize();
+
+// Queues invalidations on another CPU and interrupts it unless an IPI is pending already.
+// Addresses in the lower half belong to `pcid`, addresses in the higher half to every PCID.
+// Too many addresses turn into a full flush, which includes global pages when `global` is set.
+void queue(size_t __cpu, const uintptr_t* __addresses, size_t __count, uint16_t __pcid,
+		   bool __flush_all, bool __global);
+// Waits until every other CPU handled what was queued for it. Invalidations queued for the
+// calling CPU are handled while waiting, so CPUs shooting at each other don't deadlock.
+void wait();
+
+void get_status(ShootdownStats* __status);
+} // namespace tlb
+} // namespace cpu
+
+#endif // CPU_TLB_HPP
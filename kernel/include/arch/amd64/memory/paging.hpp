@@ -55,6 +55,12 @@ struct PageTableEntry
 		return this->val & PAGE_ADDR_MASK;
 	}
 
+	// The PAT bit of a large page sits inside the address field.
+	constexpr uintptr_t get_address(size_t __page_size)
+	{
+		return this->val & PAGE_ADDR_MASK & ~(__page_size - 1);
+	}
+
 	constexpr void set_address(uintptr_t __address)
 	{
 		auto temp = this->val;
@@ -63,10 +69,29 @@ struct PageTableEntry
 		this->val = temp;
 	}
 
+	// Lockless walks see an entry either before or after a change, never half written, and
+	// see a new table filled in before the entry pointing to it.
+	void store(uintptr_t __value)
+	{
+		__atomic_store_n(&this->val, __value, __ATOMIC_RELEASE);
+	}
+
+	uintptr_t load() const
+	{
+		return __atomic_load_n(&this->val, __ATOMIC_ACQUIRE);
+	}
+
 	bool is_valid();
 	bool is_large();
 };
 
+// Physically contiguous piece of a virtual buffer.
+struct PhysicalSegment
+{
+	uintptr_t address;
+	size_t size;
+};
+
 struct PageTable
 {
 	PageTableEntry entries[512];
@@ -93,12 +118,18 @@ class PageMap
 
 	void initialize(bool __kernel_pagemap = false);
 
-	void* get_next_lvl(PageTableEntry& __entry, bool __allocate, uintptr_t __virtual_address = -1,
-					   size_t __old_page_size = -1, size_t __page_size = -1);
+	void* get_next_lvl(PageTableEntry& __entry, bool __allocate, size_t __old_page_size = -1);
 	PageTableEntry* virtual_to_entry(uintptr_t __virtual_address, bool __allocate,
-									 size_t __page_size, bool __check_large);
-	uintptr_t virtual_to_physical(uintptr_t __virtual_address, size_t __flags = 0);
-
+									 size_t __page_size, bool __check_large,
+									 size_t* __entry_size = nullptr);
+	// Lookups don't take the lock, see walk_lockless.
+	uintptr_t virtual_to_physical(uintptr_t __virtual_address);
+	// Translates a whole buffer into at most `max` physically contiguous segments. Stops at the
+	// first unmapped page, so the segment sizes add up to the part that was translated.
+	size_t translate(uintptr_t __virtual_address, size_t __size, PhysicalSegment* __segments,
+					 size_t __max);
+
+	// Wrappers around the range operations, `flags` also selects the page size.
 	error_t map_page(uintptr_t __virtual_address, uintptr_t __physical_address, size_t __flags);
 	error_t unmap_page(uintptr_t __virtual_address, size_t __flags = 0);
 	error_t setflags_page(uintptr_t __virtual_address, size_t __flags);
@@ -112,21 +143,57 @@ class PageMap
 	error_t remap_pages(uintptr_t __old_virtual_address, uintptr_t __new_virtual_address,
 						size_t __size, size_t __flags);
 
-	void load();
+	// Range operations walk the tree once, using the largest pages the alignment allows. The TLB
+	// is flushed once at the end, and other CPUs are waited for after the lock is dropped. An
+	// unmap that empties many tables drops the lock every RANGE_TABLE_BATCH tables to free them.
+	error_t map_range(uintptr_t __virtual_address, uintptr_t __physical_address, size_t __size,
+					  size_t __flags);
+	error_t unmap_range(uintptr_t __virtual_address, size_t __size);
+	error_t protect_range(uintptr_t __virtual_address, size_t __size, size_t __flags);
+	// Replaces tables that map a contiguous, aligned and uniformly flagged range with one large
+	// page and frees them. Returns the number of tables collapsed.
+	size_t collapse_range(uintptr_t __virtual_address, size_t __size);
+
+	// Switches to the page map. Without `flush`, TLB entries tagged with its PCID are kept.
+	void load(bool __flush = false);
 	void save();
 
   private:
 	size_t vmm_flags(size_t __flags, bool __large_pages);
 	size_t parse_flags(size_t __flags);
 	void destroy_level(PageTable* __pml, int __start, int __end, int __level);
+	// Returns the entry mapping `virtual_address` and the size of its page, or 0.
+	uintptr_t walk_lockless(uintptr_t __virtual_address, size_t& __page_size);
+
+	struct RangeWalk;
+	error_t walk_range(RangeWalk& __walk, PageTable* __pml, int __level,
+					   uintptr_t __virtual_address, uintptr_t __end);
+	error_t start_walk(RangeWalk& __walk, uintptr_t __virtual_address, size_t __size);
+	size_t collapse_level(RangeWalk& __walk, PageTable* __pml, int __level,
+						  uintptr_t __virtual_address);
+
+	uint16_t get_pcid(bool& __flush);
+	void drop_pcid();
 
 	PageTable* top_lvl_ = nullptr;
 	lock::mutex lock_;
+
+	uint16_t pcid_ = 0;
+	uint64_t pcid_generation_ = 0;
 };
 
 extern PageMap base_pagemap;
 
 PageMap* get_current_pagemap();
+
+// Turns on global pages and PCIDs on the calling CPU, once its per-CPU data is reachable.
+void paging_initialize_cpu();
+// Collapses the kernel tables of one top level entry, at most once per COLLAPSE_INTERVAL_MS.
+// Returns whether it ran, the idle loop calls it when it has nothing else to do.
+bool paging_collapse_step();
+size_t paging_collapsed_tables();
+// Logs the cost of switching address spaces with and without PCIDs.
+void paging_benchmark_switch();
 } // namespace memory
 
 #endif // MEMORY_PAGING_HPP
\ No newline at end of file
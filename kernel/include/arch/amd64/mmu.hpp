@@ -10,8 +10,19 @@
 #define PAGE_FLAG_DIRTY (1 << 6)
 #define PAGE_FLAG_SIZE_EXTENSION (1 << 7)
 #define PAGE_FLAG_GLOBAL (1 << 8)
+#define PAGE_FLAG_PAT (1 << 7)
+#define PAGE_FLAG_LARGE_PAT (1 << 12)
 #define PAGE_FLAG_NO_EXECUTE (1UL << 63)
 
+// Keeps the TLB entries of the new PCID when written to CR3.
+#define CR3_NOFLUSH (1ul << 63)
+#define CR3_PCID_MASK 0xffful
+#define PCID_COUNT 4096
+
+// Zeroed frames every CPU keeps for new page tables, and how many a refill takes at once.
+#define PAGE_TABLE_CACHE_SIZE 16
+#define PAGE_TABLE_CACHE_BATCH (PAGE_TABLE_CACHE_SIZE / 2)
+
 #define NEW_PAGE_FLAGS (PAGE_FLAG_PRESENT | PAGE_FLAG_WRITABLE | PAGE_FLAG_USER_ACCESSIBLE)
 
 #define PAGE_FAULT_PRESENT (1 << 0)
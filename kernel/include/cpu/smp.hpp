@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/defs.h>
 
 namespace cpu
 {
@@ -14,6 +15,17 @@ void initialize_bsp();
 void initialize();
 
 PlatformCpuData* get_cpu_data();
+PlatformCpuData* get_cpu_data(size_t __id);
+size_t get_cpu_count();
+
+// Whether `get_cpu_data()` can be used on the calling CPU.
+bool cpu_data_initialized();
+
+// Interrupts a halted CPU, so it looks for background work again.
+void wake(size_t __id);
+
+// Spends the rest of the CPU's time on background work, halting when there is none.
+__NO_RETURN void idle();
 } // namespace smp
 } // namespace cpu
 
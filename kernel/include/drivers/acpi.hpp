@@ -14,11 +14,17 @@ void get_io_apic(std::vector<acpi_madt_ioapic>& __ioapics);
 void get_interrupt_overrides(std::vector<acpi_madt_interrupt_source_override>& __overrides);
 void get_local_apic(std::vector<acpi_madt_lapic>& __lapics);
 
+void get_memory_affinities(std::vector<acpi_srat_memory_affinity>& __affinities);
+void get_processor_affinities(std::vector<acpi_srat_processor_affinity>& __affinities);
+void get_x2apic_affinities(std::vector<acpi_srat_x2apic_affinity>& __affinities);
+uint8_t get_locality_distance(uint32_t __from, uint32_t __to);
+
 acpi_fadt* get_fadt();
 bool legacy_pic();
 
 void initialize();
 void initialize_madt();
+void initialize_srat();
 } // namespace acpi
 } // namespace drivers
 
@@ -4,6 +4,7 @@
 #include <limine.h>
 #include <sys/defs.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 __CDECLS_BEGIN
 extern volatile struct limine_memmap_request memmap_request;
@@ -13,7 +14,22 @@ extern volatile struct limine_kernel_file_request kernel_file_request;
 extern volatile struct limine_paging_mode_request paging_mode_request;
 extern volatile struct limine_rsdp_request rsdp_request;
 extern volatile struct limine_smp_request smp_request;
+extern volatile struct limine_stack_size_request stack_size_request;
 
+// Copies of the responses that are still needed once bootloader-reclaimable memory is freed.
+struct boot_info
+{
+	uintptr_t hhdm_offset;
+	uintptr_t kernel_virtual_base;
+	uintptr_t kernel_physical_base;
+	uint64_t cpu_count;
+	uint32_t bsp_lapic_id;
+	bool paging_mode_max;
+};
+
+extern struct boot_info boot_info;
+
+void initialize_boot_info(void);
 bool is_paging_mode_max(void);
 __CDECLS_END
 
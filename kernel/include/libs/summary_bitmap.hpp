@@ -0,0 +1,652 @@
+#ifndef LIBS_SUMMARY_BITMAP_HPP
+#define LIBS_SUMMARY_BITMAP_HPP 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+/**
+ * @brief A bitmap with summary levels to find clear bits without scanning every bit.
+ *
+ * Level 0 holds one bit per tracked item (set = used). Every level above holds one bit
+ * per 64-bit word of the level below, which is set when that word is completely used.
+ * Searches skip full words through the summaries and locate clear bits with `tzcnt`.
+ *
+ * A second set of summaries tracks completely clear words, so naturally aligned blocks
+ * larger than a word can be found without looking at level 0.
+ */
+class SummaryBitmap
+{
+  public:
+	static constexpr size_t npos = static_cast<size_t>(-1);
+	static constexpr size_t max_levels = 8;
+
+	constexpr SummaryBitmap() = default;
+
+	// Deleted copy and move constructors and assignment operators to avoid accidental copying
+	constexpr SummaryBitmap(const SummaryBitmap&) = delete;
+	constexpr SummaryBitmap(SummaryBitmap&&) = delete;
+	constexpr SummaryBitmap& operator=(const SummaryBitmap&) = delete;
+	constexpr SummaryBitmap& operator=(SummaryBitmap&&) = delete;
+
+	~SummaryBitmap() = default;
+
+	/**
+	 * @brief Calculates the storage needed for a bitmap and all of its summary levels.
+	 *
+	 * @param size Number of bits tracked by the bitmap.
+	 * @return Size of the storage in bytes.
+	 */
+	static constexpr size_t storage_size(size_t size)
+	{
+		size_t words = 0;
+		size_t bits = size;
+
+		size_t summary_words = 0;
+
+		bits = word_count(bits);
+		words += bits;
+
+		while(bits > 1)
+		{
+			bits = word_count(bits);
+			summary_words += bits;
+		}
+
+		// Full and empty summaries have the same layout.
+		return (words + (summary_words * 2)) * sizeof(uint64_t);
+	}
+
+	/**
+	 * @brief Initializes the bitmap and marks every bit as used.
+	 *
+	 * @param buffer Storage of at least `storage_size(size)` bytes.
+	 * @param size Number of bits tracked by the bitmap.
+	 */
+	void initialize(uint64_t* buffer, size_t size)
+	{
+		assert((buffer != nullptr) && (size != 0));
+
+		size_t offset = 0;
+		size_t bits = size;
+
+		this->buffer_ = buffer;
+		this->levels_ = 0;
+
+		do
+		{
+			assert(this->levels_ < max_levels);
+
+			this->level_bits_[this->levels_] = bits;
+			this->level_offset_[this->levels_] = offset;
+			this->levels_++;
+
+			bits = word_count(bits);
+			offset += bits;
+		} while(bits > 1);
+
+		// Padding bits past the end of each level stay set, so they are never found.
+		for(size_t i = 0; i < offset; i++)
+		{
+			this->buffer_[i] = ~0ull;
+		}
+
+		// Nothing is empty yet. Padding bits of the empty summaries stay clear, so a
+		// partially backed word never counts as empty.
+		this->empty_offset_ = (this->levels_ > 1) ? (offset - this->level_offset_[1]) : 0;
+
+		for(size_t i = offset; i < (offset + this->empty_offset_); i++)
+		{
+			this->buffer_[i] = 0;
+		}
+	}
+
+	/**
+	 * @brief Checks if a specific bit is set.
+	 *
+	 * @param index Index of the bit.
+	 * @return true if the bit is set, false otherwise.
+	 */
+	bool test(size_t index) const
+	{
+		assert(index < this->size());
+		return this->words(0)[index / 64] & (1ull << (index % 64));
+	}
+
+	/**
+	 * @brief Sets a bit and marks its word as full in the summaries if needed.
+	 *
+	 * @param index Index of the bit.
+	 */
+	void set(size_t index)
+	{
+		assert(index < this->size());
+
+		const bool was_empty = (this->words(0)[index / 64] == 0);
+
+		for(size_t level = 0, i = index; level < this->levels_; level++, i /= 64)
+		{
+			uint64_t& word = this->words(level)[i / 64];
+			word |= (1ull << (i % 64));
+
+			if(word != ~0ull)
+			{
+				break;
+			}
+		}
+
+		if(!was_empty)
+		{
+			return;
+		}
+
+		for(size_t level = 1, i = index / 64; level < this->levels_; level++, i /= 64)
+		{
+			uint64_t& word = this->empty(level)[i / 64];
+			const bool was_all_empty = (word == ~0ull);
+
+			word &= ~(1ull << (i % 64));
+
+			if(!was_all_empty)
+			{
+				break;
+			}
+		}
+	}
+
+	/**
+	 * @brief Clears a bit and marks its word as not full in the summaries if needed.
+	 *
+	 * @param index Index of the bit.
+	 */
+	void clear(size_t index)
+	{
+		assert(index < this->size());
+
+		for(size_t level = 0, i = index; level < this->levels_; level++, i /= 64)
+		{
+			uint64_t& word = this->words(level)[i / 64];
+			const bool was_full = (word == ~0ull);
+
+			word &= ~(1ull << (i % 64));
+
+			if(!was_full)
+			{
+				break;
+			}
+		}
+
+		if(this->words(0)[index / 64] != 0)
+		{
+			return;
+		}
+
+		for(size_t level = 1, i = index / 64; level < this->levels_; level++, i /= 64)
+		{
+			uint64_t& word = this->empty(level)[i / 64];
+			word |= (1ull << (i % 64));
+
+			if(word != ~0ull)
+			{
+				break;
+			}
+		}
+	}
+
+	/**
+	 * @brief Sets every bit within a range, a word at a time.
+	 *
+	 * @param start First bit of the range.
+	 * @param end One past the last bit of the range.
+	 */
+	void set_range(size_t start, size_t end)
+	{
+		assert((start <= end) && (end <= this->size()));
+		this->update_range(0, start, end, true, false);
+	}
+
+	/**
+	 * @brief Clears every bit within a range, a word at a time.
+	 *
+	 * @param start First bit of the range.
+	 * @param end One past the last bit of the range.
+	 */
+	void clear_range(size_t start, size_t end)
+	{
+		assert((start <= end) && (end <= this->size()));
+		this->update_range(0, start, end, false, false);
+	}
+
+	/**
+	 * @brief Finds the first clear bit within a range.
+	 *
+	 * @param start First bit of the range.
+	 * @param end One past the last bit of the range.
+	 * @return Index of the bit, or `npos` if every bit in the range is set.
+	 */
+	size_t find_clear(size_t start, size_t end) const
+	{
+		return this->find_clear_at(0, start, (end < this->size()) ? end : this->size());
+	}
+
+	/**
+	 * @brief Finds the first set bit within a range.
+	 *
+	 * Completely clear words are skipped through the empty summaries.
+	 *
+	 * @param start First bit of the range.
+	 * @param end One past the last bit of the range.
+	 * @return Index of the bit, or `npos` if every bit in the range is clear.
+	 */
+	size_t find_set(size_t start, size_t end) const
+	{
+		return this->find_set_at(0, start, (end < this->size()) ? end : this->size());
+	}
+
+	/**
+	 * @brief Finds the first run of `count` consecutive clear bits within a range.
+	 *
+	 * Words are walked run by run with `tzcnt`, and completely used words are skipped
+	 * through the first summary level.
+	 *
+	 * @param count Length of the run.
+	 * @param start First bit of the range.
+	 * @param end One past the last bit of the range.
+	 * @return Index of the first bit of the run, or `npos` if no such run exists.
+	 */
+	size_t find_clear_run(size_t count, size_t start, size_t end) const
+	{
+		const uint64_t* bitmap = this->words(0);
+		end = (end < this->size()) ? end : this->size();
+
+		if(count <= 1)
+		{
+			return this->find_clear(start, end);
+		}
+
+		size_t run = 0;
+		size_t run_start = 0;
+
+		while(start < end)
+		{
+			const size_t word = start / 64;
+			const uint64_t value = bitmap[word] | range_mask(word, start, end);
+
+			if(value == ~0ull)
+			{
+				run = 0;
+
+				if(this->levels_ == 1)
+				{
+					start = (word + 1) * 64;
+					continue;
+				}
+
+				const size_t next = this->find_clear_at(1, word + 1, word_count(end));
+
+				if(next == npos)
+				{
+					return npos;
+				}
+
+				start = next * 64;
+				continue;
+			}
+
+			size_t bit = start % 64;
+
+			while(bit < 64)
+			{
+				const uint64_t vacant = ~value >> bit;
+
+				if(vacant == 0)
+				{
+					break;
+				}
+
+				const size_t used = static_cast<size_t>(__builtin_ctzll(vacant));
+
+				if(used != 0)
+				{
+					run = 0;
+					bit += used;
+				}
+
+				const uint64_t occupied = value >> bit;
+				const size_t zeros =
+					(occupied == 0) ? (64 - bit) : static_cast<size_t>(__builtin_ctzll(occupied));
+
+				if(run == 0)
+				{
+					run_start = (word * 64) + bit;
+				}
+
+				run += zeros;
+
+				if(run >= count)
+				{
+					return run_start;
+				}
+
+				bit += zeros;
+			}
+
+			// Runs only carry over into the next word if they reach the top bit.
+			if(value & (1ull << 63))
+			{
+				run = 0;
+			}
+
+			start = (word + 1) * 64;
+		}
+
+		return npos;
+	}
+
+	/**
+	 * @brief Finds a naturally aligned block of clear bits within a range.
+	 *
+	 * Blocks of up to a word are found by folding each word onto itself. Larger blocks
+	 * are looked up in the empty summaries, where one bit stands for a clear word
+	 * (or a clear word of the level below), so the search never touches level 0.
+	 *
+	 * @param count Size of the block, a power of two.
+	 * @param align Alignment of the block, a power of two. Raised to `count` if smaller.
+	 * @param start First bit of the range.
+	 * @param end One past the last bit of the range.
+	 * @return Index of the first bit of the block, or `npos` if no such block exists.
+	 */
+	size_t find_clear_aligned(size_t count, size_t align, size_t start, size_t end) const
+	{
+		assert((count != 0) && ((count & (count - 1)) == 0));
+		assert((align == 0) || ((align & (align - 1)) == 0));
+
+		align = (align > count) ? align : count;
+		end = (end < this->size()) ? end : this->size();
+		start = (start + align - 1) & ~(align - 1);
+
+		// Pick the level where the block spans at most one word.
+		size_t level = 0;
+		size_t unit = 1;
+
+		while(count > (unit * 64))
+		{
+			unit *= 64;
+
+			if(++level >= this->levels_)
+			{
+				return npos;
+			}
+		}
+
+		// From here on everything is counted in bits of `level`.
+		const size_t level_count = count / unit;
+		const size_t level_align = align / unit;
+		const size_t level_end = end / unit;
+		const size_t step = (level_align > 64) ? (level_align / 64) : 1;
+
+		uint64_t align_mask = 1;
+
+		if(level_align < 64)
+		{
+			align_mask = ~0ull / ((1ull << level_align) - 1);
+		}
+
+		size_t word = (start / unit) / 64;
+
+		while((word * 64) < level_end)
+		{
+			uint64_t value = this->vacant(level, word);
+			value &= ~range_mask(word, start / unit, level_end);
+
+			for(size_t shift = 1; shift < level_count; shift <<= 1)
+			{
+				value &= (value >> shift);
+			}
+
+			value &= align_mask;
+
+			if(value != 0)
+			{
+				return ((word * 64) + static_cast<size_t>(__builtin_ctzll(value))) * unit;
+			}
+
+			// Skip words whose whole subtree is in use.
+			if(((level + 1) < this->levels_) && (this->vacant(level, word) == 0))
+			{
+				const size_t next =
+					this->find_clear_at(level + 1, word + 1, word_count(level_end));
+
+				if(next == npos)
+				{
+					return npos;
+				}
+
+				word = ((next + step - 1) / step) * step;
+				continue;
+			}
+
+			word += step;
+		}
+
+		return npos;
+	}
+
+	/**
+	 * @brief Counts the clear bits within a range.
+	 *
+	 * @param start First bit of the range.
+	 * @param end One past the last bit of the range.
+	 * @return Number of clear bits.
+	 */
+	size_t count_clear(size_t start, size_t end) const
+	{
+		const uint64_t* bitmap = this->words(0);
+		size_t count = 0;
+
+		end = (end < this->size()) ? end : this->size();
+
+		for(size_t word = start / 64; (word * 64) < end; word++)
+		{
+			const uint64_t value = bitmap[word] | range_mask(word, start, end);
+			count += static_cast<size_t>(__builtin_popcountll(~value));
+		}
+
+		return count;
+	}
+
+	/**
+	 * @brief Returns the number of bits tracked by the bitmap.
+	 */
+	size_t size() const
+	{
+		return this->level_bits_[0];
+	}
+
+	/**
+	 * @brief Returns the buffer associated with this bitmap.
+	 */
+	uint64_t* buffer() const
+	{
+		return this->buffer_;
+	}
+
+  private:
+	static constexpr size_t word_count(size_t bits)
+	{
+		return (bits + 63) / 64;
+	}
+
+	// Mask of the bits of `word` that lie outside of [start, end).
+	static constexpr uint64_t range_mask(size_t word, size_t start, size_t end)
+	{
+		uint64_t mask = 0;
+
+		if(start > (word * 64))
+		{
+			mask |= (1ull << (start - (word * 64))) - 1;
+		}
+
+		if(end < ((word + 1) * 64))
+		{
+			mask |= ~((1ull << (end - (word * 64))) - 1);
+		}
+
+		return mask;
+	}
+
+	uint64_t* words(size_t level) const
+	{
+		return this->buffer_ + this->level_offset_[level];
+	}
+
+	// Level 1 and up of the empty summaries, laid out right after the full summaries.
+	uint64_t* empty(size_t level) const
+	{
+		return this->buffer_ + this->level_offset_[level] + this->empty_offset_;
+	}
+
+	// Bits of `word` that are available: clear bits of level 0, or empty summary bits.
+	uint64_t vacant(size_t level, size_t word) const
+	{
+		return (level == 0) ? ~this->words(0)[word] : this->empty(level)[word];
+	}
+
+	// Sets or clears [start, end) of a level of the full (or empty) summaries. Words whose
+	// summary bit changes are collected into runs and forwarded to the level above at once.
+	void update_range(size_t level, size_t start, size_t end, bool set, bool is_empty)
+	{
+		uint64_t* bitmap = is_empty ? this->empty(level) : this->words(level);
+		const bool has_parent = ((level + 1) < this->levels_);
+
+		size_t full_start = 0;
+		size_t full_end = 0;
+		size_t empty_start = 0;
+		size_t empty_end = 0;
+
+		for(size_t word = start / 64; (word * 64) < end; word++)
+		{
+			const uint64_t mask = ~range_mask(word, start, end);
+			const uint64_t old = bitmap[word];
+			const uint64_t value = set ? (old | mask) : (old & ~mask);
+
+			bitmap[word] = value;
+
+			// Full summaries follow full words, empty summaries follow empty words.
+			if(has_parent && ((old == ~0ull) != (value == ~0ull)))
+			{
+				if(full_end != word)
+				{
+					if(full_start != full_end)
+					{
+						this->update_range(level + 1, full_start, full_end, set, is_empty);
+					}
+
+					full_start = word;
+				}
+
+				full_end = word + 1;
+			}
+
+			if(!is_empty && (level == 0) && (this->levels_ > 1) && ((old == 0) != (value == 0)))
+			{
+				if(empty_end != word)
+				{
+					if(empty_start != empty_end)
+					{
+						this->update_range(1, empty_start, empty_end, !set, true);
+					}
+
+					empty_start = word;
+				}
+
+				empty_end = word + 1;
+			}
+		}
+
+		if(full_start != full_end)
+		{
+			this->update_range(level + 1, full_start, full_end, set, is_empty);
+		}
+
+		if(empty_start != empty_end)
+		{
+			this->update_range(1, empty_start, empty_end, !set, true);
+		}
+	}
+
+	size_t find_clear_at(size_t level, size_t start, size_t end) const
+	{
+		const uint64_t* bitmap = this->words(level);
+
+		while(start < end)
+		{
+			const size_t word = start / 64;
+			const uint64_t value = bitmap[word] | range_mask(word, start, end);
+
+			if(value != ~0ull)
+			{
+				return (word * 64) + static_cast<size_t>(__builtin_ctzll(~value));
+			}
+
+			if((level + 1) == this->levels_)
+			{
+				start = (word + 1) * 64;
+				continue;
+			}
+
+			const size_t next = this->find_clear_at(level + 1, word + 1, word_count(end));
+
+			if(next == npos)
+			{
+				return npos;
+			}
+
+			start = next * 64;
+		}
+
+		return npos;
+	}
+
+	// Level 0 is searched for set bits, the empty summaries for words that aren't empty.
+	size_t find_set_at(size_t level, size_t start, size_t end) const
+	{
+		while(start < end)
+		{
+			const size_t word = start / 64;
+			uint64_t value = (level == 0) ? this->words(0)[word] : ~this->empty(level)[word];
+
+			value &= ~range_mask(word, start, end);
+
+			if(value != 0)
+			{
+				return (word * 64) + static_cast<size_t>(__builtin_ctzll(value));
+			}
+
+			if((level + 1) == this->levels_)
+			{
+				start = (word + 1) * 64;
+				continue;
+			}
+
+			const size_t next = this->find_set_at(level + 1, word + 1, word_count(end));
+
+			if(next == npos)
+			{
+				return npos;
+			}
+
+			start = next * 64;
+		}
+
+		return npos;
+	}
+
+	uint64_t* buffer_ = nullptr; ///< Storage of every level, level 0 first.
+	size_t levels_ = 0; ///< Number of levels, including level 0.
+	size_t level_bits_[max_levels] = {}; ///< Number of bits tracked by each level.
+	size_t level_offset_[max_levels] = {}; ///< Offset of each level into the buffer, in words.
+	size_t empty_offset_ = 0; ///< Distance between a full summary and its empty summary, in words.
+};
+
+#endif // LIBS_SUMMARY_BITMAP_HPP
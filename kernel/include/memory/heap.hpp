@@ -1,17 +1,121 @@
 #ifndef MEMORY_HEAP_HPP
 #define MEMORY_HEAP_HPP 1
 
+#include <atomic>
+#include <errno.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/defs.h>
+
+#include <memory/memory.hpp>
+
+// Requests up to HEAP_SLAB_MAX bytes are served from slabs of one size class each, larger ones
+// by the buddy allocator.
+#define HEAP_SLAB_CLASSES 14
+#define HEAP_SLAB_MAX 2048
+#define HEAP_SLAB_SIZE (16 * 1024)
+
+// The heap is made of buddy arenas of at least HEAP_ARENA_PAGES, added when the others are full
+// and given back once they are empty. It stops growing at 1/HEAP_LIMIT_DIVISOR of the RAM.
+#define HEAP_ARENA_PAGES 4096ul
+#define HEAP_MAX_ARENAS 64
+#define HEAP_LIMIT_DIVISOR 4
 
 namespace memory
 {
+struct Slab;
+
+struct SlabClass
+{
+	// Slabs with free objects. Full slabs are on no list, and one empty slab is kept back so
+	// a class hovering around a slab boundary doesn't keep going to the buddy allocator.
+	Slab* partial;
+	Slab* empty;
+
+	// Only written by the owner, with relaxed atomic stores, since any CPU may read them.
+	size_t slabs;
+	size_t used_objects;
+};
+
+// Slabs a CPU allocates from and frees to without a lock, with interrupts disabled. Objects of
+// these slabs freed on other CPUs are pushed to `remote_free`, and returned to their slab by
+// the owner once it runs out of objects or goes idle.
+struct __ALIGNED(64) HeapCache
+{
+	SlabClass classes[HEAP_SLAB_CLASSES];
+	std::atomic<void*> remote_free;
+	// Objects this CPU freed to slabs of other CPUs, written like the class counters.
+	size_t remote_frees;
+
+	// Set by heap_benchmark_smp to make the CPU run its part from the idle loop.
+	std::atomic<bool> benchmark_pending;
+};
+
+struct HeapStats
+{
+	size_t arenas;
+	size_t arena_size;
+	size_t peak_arena_size;
+	size_t limit;
+	// Bytes handed out by the buddy allocators, slabs included.
+	size_t used_size;
+};
+
+struct HeapSlabStats
+{
+	size_t object_size;
+	size_t slabs;
+	size_t objects;
+	size_t used_objects;
+};
+
 void heap_initialize();
 
 void* heap_malloc(size_t __size);
 void* heap_calloc(size_t __nmemb, size_t __size);
 void* heap_realloc(void* __ptr, size_t __new_size);
 void heap_free(void* __ptr);
+
+// Returns `size` bytes starting at a multiple of `alignment`, a power of two of up to 2 MiB.
+// The size is rounded up to the alignment, so the object doesn't share its last cache line or
+// page with the next one either. Freed with heap_free, but heap_realloc doesn't keep the
+// alignment.
+void* heap_aligned_alloc(size_t __alignment, size_t __size);
+
+// Frees an allocation given the size, and alignment, it was made with. Slab objects are freed
+// without looking up their arena. Debug builds, or HEAP_CHECK_SIZED_FREE, check the size
+// against the slab class or buddy block.
+void heap_free_sized(void* __ptr, size_t __size);
+void heap_free_aligned_sized(void* __ptr, size_t __alignment, size_t __size);
+
+// Objects written by one CPU and read by others, that must not share a cache line.
+inline void* heap_cache_aligned_alloc(size_t __size)
+{
+	return heap_aligned_alloc(CACHE_LINE_SIZE, __size);
+}
+
+// Objects the hardware wants in as few pages as possible, like descriptor tables.
+inline void* heap_page_aligned_alloc(size_t __size)
+{
+	return heap_aligned_alloc(PAGE_SIZE, __size);
+}
+
+void heap_get_status(HeapStats* __status);
+error_t heap_get_slab_status(size_t __size_class, HeapSlabStats* __status);
+// Logs the arenas and the slabs of every size class in use.
+void heap_dump_status();
+
+// Background work of an idle CPU: takes back its objects freed by other CPUs. Returns false if
+// there was nothing to do.
+bool heap_idle_work();
+// Whether another CPU left work for heap_idle_work, e.g. before waking this one up.
+bool heap_idle_pending();
+
+// Walks the first heap arena and an arena of 4 KiB pages, and logs the dTLB misses and cycles
+// of both.
+void heap_benchmark_walk();
+// Runs the same allocation loop on 1, 2, 4, ... CPUs at once and logs the allocation rate.
+void heap_benchmark_smp();
 } // namespace memory
 
 #endif // MEMORY_HEAP_HPP
\ No newline at end of file
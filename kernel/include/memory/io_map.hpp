@@ -0,0 +1,38 @@
+#ifndef MEMORY_IO_MAP_HPP
+#define MEMORY_IO_MAP_HPP 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <memory/virtual.hpp>
+
+// Mappings kept around once nobody uses them, before the oldest one is torn down.
+#define IO_MAP_CACHE_SIZE 32
+// Buckets of the lookup tables by physical and by virtual address.
+#define IO_MAP_BUCKETS 64
+
+namespace memory
+{
+struct IoMapStats
+{
+	size_t mappings;
+	size_t unused_mappings;
+
+	size_t hits;
+	size_t misses;
+	size_t direct;
+	size_t evictions;
+};
+
+// Maps physical memory for device access, like ioremap. Mappings are shared by start page and
+// flags and counted, and unused ones are only torn down once too many piled up, so mapping the
+// same registers over and over only costs a lookup. RAM is served from the direct map instead,
+// write-back whatever `flags` asks for, so it is never mapped with two cache types.
+void* io_map(uintptr_t __physical_address, size_t __size,
+			 size_t __flags = MAP_READ | MAP_WRITE | MAP_MMIO);
+void io_unmap(void* __ptr, size_t __size);
+
+void io_map_get_status(IoMapStats* __status);
+} // namespace memory
+
+#endif // MEMORY_IO_MAP_HPP
@@ -9,6 +9,8 @@
 #define PAGE_SIZE_2MiB 0x200000UL
 #define PAGE_SIZE_1GiB 0x40000000UL
 
+#define CACHE_LINE_SIZE 64UL
+
 namespace memory
 {
 template<typename T>
@@ -18,21 +20,21 @@ using GetRetType =
 
 inline constexpr bool is_higher_half(auto __addr)
 {
-	return uintptr_t(__addr) >= hhdm_request.response->offset;
+	return uintptr_t(__addr) >= boot_info.hhdm_offset;
 }
 
 template<typename T, typename U = GetRetType<T>>
 inline constexpr U to_higher_half(T __addr)
 {
 	return is_higher_half(__addr) ? U(__addr) :
-									U(uintptr_t(__addr) + hhdm_request.response->offset);
+									U(uintptr_t(__addr) + boot_info.hhdm_offset);
 }
 
 template<typename T, typename U = GetRetType<T>>
 inline constexpr U from_higher_half(T __addr)
 {
 	return !is_higher_half(__addr) ? U(__addr) :
-									 U(uintptr_t(__addr) - hhdm_request.response->offset);
+									 U(uintptr_t(__addr) - boot_info.hhdm_offset);
 }
 
 template<std::integral T, std::integral U>
@@ -48,7 +50,7 @@ inline constexpr auto align_up(std::integral auto __addr, std::integral auto __s
 
 inline constexpr auto div_roundup(std::integral auto __addr, std::integral auto __size)
 {
-	return align_down(__addr, __size) / __size;
+	return align_up(__addr, __size) / __size;
 }
 
 inline constexpr bool is_aligned(std::integral auto __addr, std::integral auto __size)
@@ -1,8 +1,45 @@
 #ifndef MEMORY_PHYSICAL_HPP
 #define MEMORY_PHYSICAL_HPP 1
 
+#include <errno.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/defs.h>
+#include <lock.hpp>
+
+// Number of frames a CPU can keep in its local cache.
+#define FRAME_CACHE_SIZE 64
+// Number of frames moved between a CPU cache and the global bitmap at once.
+#define FRAME_CACHE_BATCH (FRAME_CACHE_SIZE / 2)
+
+// Number of frames idle CPUs keep zeroed ahead of time.
+#define ZERO_POOL_SIZE 256
+// Idle CPUs stop zeroing ahead once their node has no more free frames than this.
+#define ZERO_POOL_LOW_WATER (ZERO_POOL_SIZE * 4)
+
+// Maximum number of NUMA nodes.
+#define PHYS_MAX_NODES 8
+
+// Skip zeroing, for callers that overwrite the whole allocation anyway.
+#define PHYS_ALLOC_NO_ZERO (1 << 0)
+// Only use memory below 4 GiB, for devices limited to 32-bit DMA.
+#define PHYS_ALLOC_DMA32 (1 << 1)
+
+// Prefer memory of `node` over the local node of the calling CPU.
+#define PHYS_ALLOC_NODE_SHIFT 16
+#define PHYS_ALLOC_NODE(node) ((static_cast<uint32_t>(node) + 1) << PHYS_ALLOC_NODE_SHIFT)
+
+// Type flags of a page frame.
+#define FRAME_FLAG_PAGE_TABLE (1 << 0)
+#define FRAME_FLAG_HEAP (1 << 1)
+#define FRAME_FLAG_PINNED (1 << 2)
+
+// Number of power-of-two buckets in the free run and latency histograms.
+#define PHYS_HISTOGRAM_BUCKETS 32
+
+// Orders of the blocks backing large pages.
+#define PHYS_ORDER_2MB 9
+#define PHYS_ORDER_1GB 18
 
 namespace memory
 {
@@ -18,16 +55,132 @@ struct PhysicalMemoryStats
 	size_t free_pages;
 };
 
+// Descriptor of a physical frame, indexed by its frame number.
+struct PageFrame
+{
+	union
+	{
+		uint32_t refcount;
+		// Page tables count their valid entries instead, to be freed once they are empty.
+		uint32_t entries;
+	};
+	uint8_t order;
+	uint8_t reserved;
+	uint16_t flags;
+
+	// Identifies the owner of the frame, e.g. the page map it belongs to.
+	uint64_t owner;
+};
+
+static_assert(sizeof(PageFrame) == 16, "Page frame descriptors must stay small");
+
+// Per-CPU magazine of free frames, refilled from and drained to the bitmap in batches.
+struct __ALIGNED(64) FrameCache
+{
+	// Only contended when an allocation is about to fail and empties every cache. Never held
+	// while taking phys_lock.
+	lock::mutex lock;
+	size_t count;
+	uintptr_t frames[FRAME_CACHE_SIZE];
+
+	size_t hits;
+	size_t misses;
+};
+
+struct FrameCacheStats
+{
+	size_t cached_pages;
+	size_t hits;
+	size_t misses;
+};
+
+struct PhysicalNodeStats
+{
+	uint32_t proximity_domain;
+	size_t spanned_pages;
+	size_t free_pages;
+};
+
+// Allocator activity of one CPU. Latency bucket `i` counts calls that took [2^i, 2^(i+1)) cycles.
+struct PhysicalCpuStats
+{
+	size_t allocations;
+	size_t frees;
+
+	size_t allocate_latency[PHYS_HISTOGRAM_BUCKETS];
+	size_t free_latency[PHYS_HISTOGRAM_BUCKETS];
+};
+
+struct PhysicalTelemetry
+{
+	// Bucket `i` counts runs of free frames with a length in [2^i, 2^(i+1)).
+	size_t free_runs[PHYS_HISTOGRAM_BUCKETS];
+	size_t largest_free_run;
+
+	size_t allocations;
+	size_t frees;
+
+	// Upper bounds of the latency percentiles, in TSC cycles.
+	uint64_t allocate_p50;
+	uint64_t allocate_p90;
+	uint64_t allocate_p99;
+	uint64_t free_p50;
+	uint64_t free_p90;
+	uint64_t free_p99;
+};
+
+struct ZeroPoolStats
+{
+	size_t zeroed_pages;
+	size_t hits;
+	size_t misses;
+};
+
 void physical_initialize();
+void physical_initialize_nodes();
+
+// Frees bootloader-reclaimable memory. No Limine response may be used afterwards.
+void physical_reclaim_bootloader_memory();
 void physical_get_status(PhysicalMemoryStats* __status);
+error_t physical_get_cache_status(size_t __cpu, FrameCacheStats* __status);
+void physical_get_zero_pool_status(ZeroPoolStats* __status);
+
+// Scans the bitmap for free runs, so unlike physical_get_status it isn't cheap.
+void physical_get_telemetry(PhysicalTelemetry* __telemetry);
+void physical_dump_telemetry();
+// Logs the latency of single frame searches with the summaries and with a linear scan, on a
+// scratch bitmap filled to several levels.
+void physical_benchmark_allocate();
+
+size_t physical_get_node_count();
+error_t physical_get_node_status(size_t __node, PhysicalNodeStats* __status);
 
-void* physical_allocate(size_t __count = 1);
+void* physical_allocate(size_t __count = 1, uint32_t __flags = 0);
 void physical_free(void* __ptr, size_t __count = 1);
 
+// Fills `frames` with `count` single frames, which don't have to be contiguous, under one
+// acquisition of the allocator lock.
+void physical_allocate_bulk(void** __frames, size_t __count, uint32_t __flags = 0);
+void physical_free_bulk(void** __frames, size_t __count);
+
+void* physical_allocate_order(size_t __order, size_t __align = 0, uint32_t __flags = 0);
+void physical_free_order(void* __ptr, size_t __order);
+
+// Returns the descriptor of the frame at the physical address `ptr`.
+PageFrame* physical_get_frame(void* __ptr);
+
+// Takes another reference to an allocated frame, to share it between mappings.
+void physical_frame_get(void* __ptr);
+// Drops a reference and frees the frame (or its order block) with the last one.
+bool physical_frame_put(void* __ptr);
+
+// Zeroes one frame into the zero pool. Returns false once the pool is full.
+bool physical_refill_zero_pool();
+
 template<typename T = void*>
-inline T physical_allocate(size_t __count = 1)
+inline T physical_allocate(size_t __count = 1, uint32_t __flags = 0)
 {
-	return reinterpret_cast<T>(physical_allocate(__count));
+	return reinterpret_cast<T>(physical_allocate(__count, __flags));
 }
 } // namespace memory
 
@@ -12,8 +12,8 @@
 #define MAP_PAGE_1GB (1 << 5)
 #define MAP_PAGE_2MB (1 << 6)
 #define MAP_MMIO (1 << 7)
-#define MAP_WRITE_THROUGH (1 << 6)
-#define MAP_PROTECTED (1 << 7)
+#define MAP_WRITE_THROUGH (1 << 11)
+#define MAP_PROTECTED (1 << 12)
 #define MAP_WRITE_COMBINING (1 << 8)
 #define MAP_WRITE_BACK (1 << 9)
 #define MAP_NO_CACHE (1 << 10)
@@ -22,14 +22,37 @@
 
 namespace memory
 {
+struct VirtualRangeStats;
+
 void virtual_initialize();
 
 void* virtual_allocate(uintptr_t __base, uintptr_t __limit, size_t __count, size_t __flags);
 void* virtual_allocate(size_t __count = 1, size_t __flags = MAP_WRITE | MAP_READ);
 void* virtual_allocate_at(uintptr_t at, size_t __count = 1, size_t flags = MAP_WRITE | MAP_READ);
+// Backs the allocation with 2 MiB pages wherever an aligned block of frames is free, and with
+// single frames where it isn't. Must be freed with virtual_free_large.
+void* virtual_allocate_large(size_t __count, size_t __flags = MAP_WRITE | MAP_READ);
+
+// Returns the direct map address of `size` bytes at `physical_address` if they are RAM, which
+// the direct map covers write-back, or nullptr if any of them is not.
+void* virtual_direct_map(uintptr_t __physical_address, size_t __size);
 
 void virtual_free(void* __ptr, size_t __count = 1);
 void virtual_free_at(void* __ptr, size_t __count = 1);
+void virtual_free_large(void* __ptr, size_t __count);
+
+// Reserves kernel address space that is only backed by memory once it is touched. Reads of an
+// untouched page see a shared zero page, the first write gives it a frame of its own.
+void* virtual_reserve(size_t __count);
+void virtual_release(void* __ptr, size_t __count);
+
+// Backs the page of a reserved region `address` lies in. Returns false if it isn't in one.
+// Reserved regions must only be touched with interrupts enabled: the fault takes locks whose
+// holders may wait for a TLB shootdown on this CPU.
+bool virtual_handle_fault(uintptr_t __address, bool __write);
+
+// Free kernel address space left to virtual_allocate and virtual_allocate_at.
+void virtual_get_status(VirtualRangeStats* __status);
 } // namespace memory
 
 #endif // MEMORY_VIRTUAL_HPP
\ No newline at end of file
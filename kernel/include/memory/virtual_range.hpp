@@ -0,0 +1,82 @@
+#ifndef MEMORY_VIRTUAL_RANGE_HPP
+#define MEMORY_VIRTUAL_RANGE_HPP 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <lock.hpp>
+
+namespace memory
+{
+// Free range of virtual address space. Ranges are kept in an AVL tree ordered by address, and
+// every node knows the size of the largest range in its subtree, so a fitting range is found
+// without visiting subtrees that are too small.
+struct VirtualRange
+{
+	uintptr_t start;
+	size_t size;
+	size_t largest;
+
+	VirtualRange* left;
+	VirtualRange* right;
+	int height;
+};
+
+struct VirtualRangeStats
+{
+	size_t free_size;
+	size_t largest_free_range;
+	size_t free_ranges;
+};
+
+// Allocator of address space, not memory: nothing is mapped. Nodes are carved out of physical
+// frames, so it works before the heap is up.
+class VirtualRangeAllocator
+{
+  public:
+	constexpr VirtualRangeAllocator()
+	{
+	}
+
+	VirtualRangeAllocator(const VirtualRangeAllocator&) = delete;
+	VirtualRangeAllocator& operator=(const VirtualRangeAllocator&) = delete;
+
+	void initialize(uintptr_t __base, uintptr_t __limit);
+
+	// Returns the lowest free range of `size` bytes aligned to `align` inside [base, limit),
+	// or 0 if there is none.
+	uintptr_t allocate(size_t __size, size_t __align, uintptr_t __base = 0,
+					   uintptr_t __limit = UINTPTR_MAX);
+	// Takes a given range out of the free space. Fails if any part of it isn't free.
+	bool reserve(uintptr_t __address, size_t __size);
+	// Returns a range, merging it with the free ranges around it.
+	void free(uintptr_t __address, size_t __size);
+	// Whether `address` lies in a free range.
+	bool contains(uintptr_t __address);
+
+	void get_status(VirtualRangeStats* __status);
+
+  private:
+	VirtualRange* allocate_node(uintptr_t __start, size_t __size);
+	void free_node(VirtualRange* __node);
+
+	VirtualRange* find_fit(VirtualRange* __node, size_t __size, size_t __align, uintptr_t __base,
+						   uintptr_t __limit, uintptr_t& __address);
+	// Range with the highest start below `address`, and with the lowest start from `address` on.
+	VirtualRange* find_before(uintptr_t __address);
+	VirtualRange* find_after(uintptr_t __address);
+
+	void remove(VirtualRange* __range);
+	void add(uintptr_t __start, size_t __size);
+
+	VirtualRange* root_ = nullptr;
+	VirtualRange* free_nodes_ = nullptr;
+
+	size_t free_size_ = 0;
+	size_t free_ranges_ = 0;
+
+	lock::mutex lock_;
+};
+} // namespace memory
+
+#endif // MEMORY_VIRTUAL_RANGE_HPP
\ No newline at end of file
@@ -16,7 +16,22 @@ void* realloc(void* ptr, size_t new_size)
 	return memory::heap_realloc(ptr, new_size);
 }
 
+void* aligned_alloc(size_t alignment, size_t size)
+{
+	return memory::heap_aligned_alloc(alignment, size);
+}
+
 void free(void* ptr)
 {
 	memory::heap_free(ptr);
+}
+
+void free_sized(void* ptr, size_t size)
+{
+	memory::heap_free_sized(ptr, size);
+}
+
+void free_aligned_sized(void* ptr, size_t alignment, size_t size)
+{
+	memory::heap_free_aligned_sized(ptr, alignment, size);
 }
\ No newline at end of file
@@ -21,24 +21,25 @@ void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
 	return malloc(size);
 }
 
-void* operator new(std::size_t size, std::align_val_t)
+void* operator new(std::size_t size, std::align_val_t alignment)
 {
-	return malloc(size);
+	return aligned_alloc(static_cast<std::size_t>(alignment), size);
 }
 
-void* operator new(std::size_t size, std::align_val_t, const std::nothrow_t&) noexcept
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
 {
-	return malloc(size);
+	return aligned_alloc(static_cast<std::size_t>(alignment), size);
 }
 
-void* operator new[](std::size_t size, std::align_val_t)
+void* operator new[](std::size_t size, std::align_val_t alignment)
 {
-	return malloc(size);
+	return aligned_alloc(static_cast<std::size_t>(alignment), size);
 }
 
-void* operator new[](std::size_t size, std::align_val_t, const std::nothrow_t&) noexcept
+void* operator new[](std::size_t size, std::align_val_t alignment,
+					 const std::nothrow_t&) noexcept
 {
-	return malloc(size);
+	return aligned_alloc(static_cast<std::size_t>(alignment), size);
 }
 
 void operator delete(void* ptr, std::align_val_t val)
@@ -46,10 +47,24 @@ void operator delete(void* ptr, std::align_val_t val)
 	free(ptr);
 }
 
-// For some reason?
-void operator delete(void* ptr, std::size_t)
+void operator delete(void* ptr, std::size_t size)
 {
-	free(ptr);
+	free_sized(ptr, size);
+}
+
+void operator delete[](void* ptr, std::size_t size)
+{
+	free_sized(ptr, size);
+}
+
+void operator delete(void* ptr, std::size_t size, std::align_val_t alignment)
+{
+	free_aligned_sized(ptr, static_cast<std::size_t>(alignment), size);
+}
+
+void operator delete[](void* ptr, std::size_t size, std::align_val_t alignment)
+{
+	free_aligned_sized(ptr, static_cast<std::size_t>(alignment), size);
 }
 
 void operator delete(void* ptr)
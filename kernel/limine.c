@@ -72,7 +72,19 @@ volatile struct limine_smp_request smp_request = {
 
 __SECTION(".limine_requests_end_marker") __USED static volatile LIMINE_REQUESTS_END_MARKER;
 
+struct boot_info boot_info = {0};
+
+void initialize_boot_info()
+{
+	boot_info.hhdm_offset = hhdm_request.response->offset;
+	boot_info.kernel_virtual_base = kernel_address_request.response->virtual_base;
+	boot_info.kernel_physical_base = kernel_address_request.response->physical_base;
+	boot_info.cpu_count = smp_request.response->cpu_count;
+	boot_info.bsp_lapic_id = smp_request.response->bsp_lapic_id;
+	boot_info.paging_mode_max = (paging_mode_request.response->mode != LIMINE_PAGING_MODE_MIN);
+}
+
 bool is_paging_mode_max()
 {
-	return paging_mode_request.response->mode != LIMINE_PAGING_MODE_MIN;
+	return boot_info.paging_mode_max;
 }
\ No newline at end of file
@@ -2,11 +2,16 @@
 #include <arch.hpp>
 #include <logger.h>
 #include <memory/memory.hpp>
+#include <memory/physical.hpp>
+#include <memory/paging.hpp>
+#include <memory/heap.hpp>
+#include <cpu/smp.hpp>
 
 __CDECLS_BEGIN
 
 __NO_RETURN void kernel_main()
 {
+	initialize_boot_info();
 	drivers::early_initialize();
 
 	LogStyle style = {
@@ -23,9 +28,20 @@ __NO_RETURN void kernel_main()
 	arch::late_initialize();
 	drivers::late_initialize();
 
+	// Nothing reads the bootloader's responses or stacks past this point.
+	memory::physical_reclaim_bootloader_memory();
+
+#ifdef BOOT_BENCHMARKS
+	memory::physical_benchmark_allocate();
+	memory::paging_benchmark_switch();
+	memory::heap_benchmark_walk();
+	memory::heap_benchmark_smp();
+	memory::heap_dump_status();
+#endif
+
 	log_info("Hello, World!");
 
-	arch::halt(true);
+	cpu::smp::idle();
 }
 
 __CDECLS_END
\ No newline at end of file
@@ -9,17 +9,776 @@
 #include <memory/heap.hpp>
 #include <memory/memory.hpp>
 
+#include <algorithm>
 #include <bit>
 
+#include <cpu/cpu.hpp>
+#include <cpu/pmu.hpp>
+#include <cpu/smp.hpp>
+#include <cpu/arch_smp.hpp>
+
+#include <drivers/timers.hpp>
+
 #define BUDDY_CPP_MANGLED
 #include "buddy_alloc.h"
 
+// Pages heap_benchmark_walk touches at most, and how often it walks them.
+#define HEAP_BENCHMARK_PAGES 8192ul
+#define HEAP_BENCHMARK_ROUNDS 8
+
+// Allocations every CPU makes in heap_benchmark_smp, and how many it keeps alive at once.
+#define HEAP_STRESS_OPERATIONS 1000000ul
+#define HEAP_STRESS_WINDOW 64
+
+// Sized frees check the size against the slab class or buddy block they free.
+#if defined(DEBUG) && !defined(HEAP_CHECK_SIZED_FREE)
+#define HEAP_CHECK_SIZED_FREE 1
+#endif
+
+// Owner of the slabs used before the per-CPU data is up.
+#define SLAB_SHARED UINT32_MAX
+
 namespace memory
 {
-void* heap_arena = nullptr;
-buddy* buddy = nullptr;
+// Header at the start of every slab. A set bit in `free` marks a free object.
+struct Slab
+{
+	Slab* prev;
+	Slab* next;
+
+	uint32_t size_class;
+	uint32_t free_count;
+	// CPU whose cache the slab belongs to, or SLAB_SHARED.
+	uint32_t owner;
+
+	uint64_t free[HEAP_SLAB_SIZE / 16 / 64];
+};
+
+// Objects start at the first cache line after the header.
+static constexpr size_t slab_objects_offset = align_up(sizeof(Slab), 64ul);
+
+static constexpr size_t slab_sizes[HEAP_SLAB_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048,
+};
+
+// A buddy allocator embedded in a range from virtual_allocate_large. The slot is unused while
+// `base` is 0.
+struct HeapArena
+{
+	uintptr_t base;
+	size_t pages;
+	struct buddy* buddy;
+
+	// One bit per slab-sized block, set if the block is a slab.
+	Bitmap slab_blocks;
+	// Live buddy allocations, the arena may be released once there are none.
+	size_t allocations;
+	// Free bytes of the buddy allocator with only the bitmap allocated.
+	size_t idle_free;
+};
+
+// Only guards the arenas and their slab bitmaps. Slabs belong to a CPU instead.
 lock::mutex heap_lock = {};
 
+// Lookups read the arenas without the lock, a slot only changes while nothing points into it.
+// The first arena is never released.
+static HeapArena arenas[HEAP_MAX_ARENAS];
+static size_t arena_slots = 0;
+static size_t arena_count = 0;
+
+// Pages of all arenas, their peak, and the high-water mark the heap may not grow past.
+static size_t arena_pages = 0;
+static size_t peak_arena_pages = 0;
+static size_t heap_limit_pages = 0;
+
+// Slabs used before the per-CPU data is up, e.g. for the per-CPU data itself.
+static SlabClass shared_classes[HEAP_SLAB_CLASSES];
+static lock::mutex shared_lock;
+
+// Size class of every multiple of 16 bytes up to HEAP_SLAB_MAX.
+static uint8_t slab_class_of[(HEAP_SLAB_MAX / 16) + 1];
+
+// CPUs that finished their part of the current heap_benchmark_smp round.
+static std::atomic_size_t heap_benchmark_done = 0;
+
+// Heap counters have a single writer, but are read by any CPU.
+static void add_count(size_t& counter, size_t delta)
+{
+	__atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_RELAXED) + delta,
+					 __ATOMIC_RELAXED);
+}
+
+static void sub_count(size_t& counter, size_t delta)
+{
+	__atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_RELAXED) - delta,
+					 __ATOMIC_RELAXED);
+}
+
+static size_t slab_capacity(size_t size_class)
+{
+	return (HEAP_SLAB_SIZE - slab_objects_offset) / slab_sizes[size_class];
+}
+
+static HeapArena* find_arena(void* ptr)
+{
+	const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+	const size_t slots = __atomic_load_n(&arena_slots, __ATOMIC_ACQUIRE);
+
+	for(size_t i = 0; i < slots; i++)
+	{
+		const uintptr_t base = __atomic_load_n(&arenas[i].base, __ATOMIC_ACQUIRE);
+
+		if((base != 0) && (address >= base) && (address < (base + (arenas[i].pages * PAGE_SIZE))))
+		{
+			return &arenas[i];
+		}
+	}
+
+	return nullptr;
+}
+
+static size_t slab_block(HeapArena* arena, void* ptr)
+{
+	return (reinterpret_cast<uintptr_t>(ptr) - arena->base) / HEAP_SLAB_SIZE;
+}
+
+// Returns the slab `ptr` was allocated from, or nullptr if it came from the buddy allocator.
+// The bit of a live slab doesn't change, so this needs no lock.
+static Slab* find_slab(void* ptr)
+{
+	HeapArena* arena = find_arena(ptr);
+
+	if((arena == nullptr) || !arena->slab_blocks.bit(slab_block(arena, ptr)))
+	{
+		return nullptr;
+	}
+
+	return reinterpret_cast<Slab*>(align_down(reinterpret_cast<uintptr_t>(ptr), HEAP_SLAB_SIZE));
+}
+
+// Maps a new arena and adds it to the heap, unless that would take the heap past its limit.
+// Mapping may wait for other CPUs, so it happens without heap_lock.
+static bool create_arena(size_t pages)
+{
+	{
+		lock::ScopedLock guard(heap_lock);
+
+		if((arena_pages + pages) > heap_limit_pages)
+		{
+			return false;
+		}
+
+		arena_pages += pages;
+	}
+
+	const size_t blocks = (pages * PAGE_SIZE) / HEAP_SLAB_SIZE;
+	uint8_t* base = static_cast<uint8_t*>(virtual_allocate_large(pages));
+	struct buddy* arena_buddy = (base != nullptr) ? buddy_embed(base, pages * PAGE_SIZE) : nullptr;
+	uint8_t* buffer = nullptr;
+
+	if(arena_buddy != nullptr)
+	{
+		buffer = static_cast<uint8_t*>(buddy_calloc(arena_buddy, div_roundup(blocks, 8ul), 1));
+	}
+
+	{
+		lock::ScopedLock guard(heap_lock);
+
+		for(size_t i = 0; (buffer != nullptr) && (i < HEAP_MAX_ARENAS); i++)
+		{
+			HeapArena& arena = arenas[i];
+
+			if(arena.base != 0)
+			{
+				continue;
+			}
+
+			arena.pages = pages;
+			arena.buddy = arena_buddy;
+			arena.slab_blocks.initialize(buffer, blocks);
+			arena.allocations = 0;
+			arena.idle_free = buddy_arena_free_size(arena_buddy);
+
+			__atomic_store_n(&arena.base, reinterpret_cast<uintptr_t>(base), __ATOMIC_RELEASE);
+			__atomic_store_n(&arena_slots, std::max(arena_slots, i + 1), __ATOMIC_RELEASE);
+			arena_count++;
+			peak_arena_pages = std::max(peak_arena_pages, arena_pages);
+
+			return true;
+		}
+
+		arena_pages -= pages;
+	}
+
+	if(base != nullptr)
+	{
+		virtual_free_large(base, pages);
+	}
+
+	return false;
+}
+
+// Takes an arena that just ran empty out of the heap, unless it is the only empty one. Keeping one
+// in reserve stops a heap hovering around an arena boundary from mapping and unmapping it over and
+// over. The first arena stays, so when it ran empty the reserve goes instead. Runs with heap_lock
+// held, so the caller unmaps the returned range once it dropped the lock.
+static void* retire_arena(HeapArena* arena, size_t& pages)
+{
+	if(arena->allocations != 0)
+	{
+		return nullptr;
+	}
+
+	HeapArena* spare = nullptr;
+
+	for(size_t i = 0; (spare == nullptr) && (i < arena_slots); i++)
+	{
+		if((&arenas[i] != arena) && (arenas[i].base != 0) && (arenas[i].allocations == 0))
+		{
+			spare = &arenas[i];
+		}
+	}
+
+	if(spare == nullptr)
+	{
+		return nullptr;
+	}
+
+	if(arena == &arenas[0])
+	{
+		arena = spare;
+	}
+
+	void* base = reinterpret_cast<void*>(arena->base);
+	pages = arena->pages;
+
+	__atomic_store_n(&arena->base, 0, __ATOMIC_RELEASE);
+	arena_pages -= pages;
+	arena_count--;
+
+	return base;
+}
+
+static void* arena_allocate(size_t size, bool zero)
+{
+	for(size_t i = 0; i < arena_slots; i++)
+	{
+		HeapArena& arena = arenas[i];
+
+		if(arena.base == 0)
+		{
+			continue;
+		}
+
+		void* ret = zero ? buddy_calloc(arena.buddy, 1, size) : buddy_malloc(arena.buddy, size);
+
+		if(ret != nullptr)
+		{
+			arena.allocations++;
+			return ret;
+		}
+	}
+
+	return nullptr;
+}
+
+// Allocates from the first arena with room, adding an arena when none has any.
+static void* buddy_allocate(size_t size, bool zero)
+{
+	{
+		lock::ScopedLock guard(heap_lock);
+		void* ret = arena_allocate(size, zero);
+
+		if(ret != nullptr)
+		{
+			return ret;
+		}
+	}
+
+	// Twice the size leaves room for the buddy metadata and slab bitmap at the arena's end.
+	const size_t pages =
+		std::max(HEAP_ARENA_PAGES, std::bit_ceil(div_roundup(size, PAGE_SIZE) * 2));
+
+	if(!create_arena(pages))
+	{
+		return nullptr;
+	}
+
+	lock::ScopedLock guard(heap_lock);
+	return arena_allocate(size, zero);
+}
+
+// Frees a buddy block, `size` is 0 unless the caller knows the size it was allocated with.
+static bool free_block(HeapArena* arena, void* ptr, size_t size)
+{
+#ifdef HEAP_CHECK_SIZED_FREE
+	if(size != 0)
+	{
+		const buddy_safe_free_status status = buddy_safe_free(arena->buddy, ptr, size);
+
+		if(status != BUDDY_SAFE_FREE_SUCCESS)
+		{
+			log_error("Sized free of %p with %lu bytes failed (%d)", ptr, size, status);
+			return false;
+		}
+
+		return true;
+	}
+#else
+	(void)size;
+#endif
+
+	// buddy_free silently ignores a pointer that isn't allocated, which would throw off the count
+	// of allocations. buddy_safe_free refuses it, but only releases a block given its size. Blocks
+	// are aligned to their size, so the offset bounds it, and every smaller power of two is tried.
+	const uintptr_t offset = reinterpret_cast<uintptr_t>(ptr) - arena->base;
+	size_t block = (offset != 0) ? (offset & -offset) : std::bit_floor(arena->pages * PAGE_SIZE);
+
+	for(; block != 0; block /= 2)
+	{
+		const buddy_safe_free_status status = buddy_safe_free(arena->buddy, ptr, block);
+
+		if(status != BUDDY_SAFE_FREE_SIZE_MISMATCH)
+		{
+			return status == BUDDY_SAFE_FREE_SUCCESS;
+		}
+	}
+
+	return false;
+}
+
+static void buddy_release(HeapArena* arena, void* ptr, size_t size)
+{
+	void* retired = nullptr;
+	size_t pages = 0;
+
+	{
+		lock::ScopedLock guard(heap_lock);
+
+		if(!free_block(arena, ptr, size))
+		{
+			return;
+		}
+
+		arena->allocations--;
+
+		retired = retire_arena(arena, pages);
+	}
+
+	if(retired != nullptr)
+	{
+		virtual_free_large(retired, pages);
+	}
+}
+
+struct BlockQuery
+{
+	void* address;
+	size_t size;
+};
+
+static void* find_block(void* context, void* address, size_t slot_size, size_t allocated)
+{
+	BlockQuery* query = static_cast<BlockQuery*>(context);
+
+	if((allocated != 0) && (address == query->address))
+	{
+		query->size = slot_size;
+		return address;
+	}
+
+	return nullptr;
+}
+
+// Size of the buddy block at `ptr`. The buddy allocator doesn't keep it anywhere, so this walks
+// the tree and is only meant for rare paths.
+static size_t block_size(HeapArena* arena, void* ptr)
+{
+	BlockQuery query = {ptr, 0};
+
+	lock::ScopedLock guard(heap_lock);
+	buddy_walk(arena->buddy, find_block, &query);
+
+	return query.size;
+}
+
+static void push_slab(Slab*& list, Slab* slab)
+{
+	slab->prev = nullptr;
+	slab->next = list;
+
+	if(list != nullptr)
+	{
+		list->prev = slab;
+	}
+
+	list = slab;
+}
+
+static void remove_slab(Slab*& list, Slab* slab)
+{
+	if(slab->prev != nullptr)
+	{
+		slab->prev->next = slab->next;
+	}
+	else
+	{
+		list = slab->next;
+	}
+
+	if(slab->next != nullptr)
+	{
+		slab->next->prev = slab->prev;
+	}
+
+	slab->prev = nullptr;
+	slab->next = nullptr;
+}
+
+// Maps memory and may wait for other CPUs, so it runs outside of the slab critical section. The
+// owner is set once the slab is published.
+static Slab* create_slab(size_t size_class)
+{
+	// Buddy blocks are aligned to their size within the arena, and the arena to 2 MiB.
+	Slab* slab = static_cast<Slab*>(buddy_allocate(HEAP_SLAB_SIZE, false));
+
+	if(slab == nullptr)
+	{
+		return nullptr;
+	}
+
+	{
+		HeapArena* arena = find_arena(slab);
+
+		lock::ScopedLock guard(heap_lock);
+		arena->slab_blocks.set(slab_block(arena, slab), true);
+	}
+
+	assert(is_aligned(reinterpret_cast<uintptr_t>(slab), HEAP_SLAB_SIZE));
+
+	const size_t capacity = slab_capacity(size_class);
+
+	memset(slab, 0, sizeof(Slab));
+	slab->size_class = static_cast<uint32_t>(size_class);
+	slab->free_count = static_cast<uint32_t>(capacity);
+
+	for(size_t i = 0; i < capacity; i += 64)
+	{
+		slab->free[i / 64] = ((capacity - i) >= 64) ? ~0ul : ((1ul << (capacity - i)) - 1);
+	}
+
+	return slab;
+}
+
+static void destroy_slab(Slab* slab)
+{
+	HeapArena* arena = find_arena(slab);
+
+	{
+		lock::ScopedLock guard(heap_lock);
+		arena->slab_blocks.set(slab_block(arena, slab), false);
+	}
+
+	buddy_release(arena, slab, HEAP_SLAB_SIZE);
+}
+
+// Slabs retired in a critical section are linked through `next` and destroyed after it.
+static void destroy_slabs(Slab* slabs)
+{
+	while(slabs != nullptr)
+	{
+		Slab* next = slabs->next;
+
+		destroy_slab(slabs);
+		slabs = next;
+	}
+}
+
+// The slab classes of this CPU with interrupts disabled, or the shared ones under their lock.
+// Only list manipulation happens in between, nothing that maps memory or waits for other CPUs.
+struct SlabContext
+{
+	SlabClass* classes;
+	HeapCache* cache;
+	uint32_t owner;
+	bool interrupts;
+};
+
+static SlabContext enter_slabs(bool shared)
+{
+	if(shared)
+	{
+		shared_lock.lock();
+		return {shared_classes, nullptr, SLAB_SHARED, false};
+	}
+
+	const bool interrupts = arch::interrupt_status();
+	disable_interrupts();
+
+	cpu::smp::PlatformCpuData* cpu_data = cpu::smp::get_cpu_data();
+
+	return {cpu_data->heap_cache.classes, &cpu_data->heap_cache,
+			static_cast<uint32_t>(cpu_data->id), interrupts};
+}
+
+static void leave_slabs(const SlabContext& context)
+{
+	if(context.owner == SLAB_SHARED)
+	{
+		shared_lock.unlock();
+	}
+	else if(context.interrupts)
+	{
+		enable_interrupts();
+	}
+}
+
+// Returns nullptr once the class has neither a partial nor an empty slab left.
+static void* take_object(SlabClass& cache, size_t size_class)
+{
+	Slab* slab = cache.partial;
+
+	if(slab == nullptr)
+	{
+		slab = cache.empty;
+		cache.empty = nullptr;
+
+		if(slab == nullptr)
+		{
+			return nullptr;
+		}
+
+		push_slab(cache.partial, slab);
+	}
+
+	size_t word = 0;
+
+	while(slab->free[word] == 0)
+	{
+		word++;
+	}
+
+	const size_t bit = static_cast<size_t>(__builtin_ctzl(slab->free[word]));
+	slab->free[word] &= ~(1ul << bit);
+
+	if(--slab->free_count == 0)
+	{
+		remove_slab(cache.partial, slab);
+	}
+
+	add_count(cache.used_objects, 1);
+
+	return reinterpret_cast<uint8_t*>(slab) + slab_objects_offset +
+		   (((word * 64) + bit) * slab_sizes[size_class]);
+}
+
+// A slab emptied while the class already holds back one is added to `retired`.
+static void put_object(SlabClass& cache, Slab* slab, void* ptr, Slab*& retired)
+{
+	const size_t index = (reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(slab) -
+						  slab_objects_offset) /
+						 slab_sizes[slab->size_class];
+
+	if(slab->free[index / 64] & (1ul << (index % 64)))
+	{
+		log_error("Double free of %p", ptr);
+		return;
+	}
+
+	slab->free[index / 64] |= 1ul << (index % 64);
+	sub_count(cache.used_objects, 1);
+
+	// A full slab gets back on the partial list, an empty one leaves it.
+	if(slab->free_count++ == 0)
+	{
+		push_slab(cache.partial, slab);
+	}
+
+	if(slab->free_count != slab_capacity(slab->size_class))
+	{
+		return;
+	}
+
+	remove_slab(cache.partial, slab);
+
+	if(cache.empty == nullptr)
+	{
+		cache.empty = slab;
+	}
+	else
+	{
+		sub_count(cache.slabs, 1);
+
+		slab->next = retired;
+		retired = slab;
+	}
+}
+
+// Returns the objects other CPUs freed to the local slabs, all at once. Runs with interrupts
+// disabled on the owning CPU.
+static size_t drain_remote(HeapCache& cache, Slab*& retired)
+{
+	void* object = cache.remote_free.exchange(nullptr, std::memory_order_acquire);
+	size_t ret = 0;
+
+	while(object != nullptr)
+	{
+		void* next = *static_cast<void**>(object);
+		Slab* slab = find_slab(object);
+
+		put_object(cache.classes[slab->size_class], slab, object, retired);
+
+		object = next;
+		ret++;
+	}
+
+	return ret;
+}
+
+// A class that ran dry gets a new slab outside of the critical section, which is published on
+// the second pass.
+static void* slab_allocate(size_t size)
+{
+	const size_t size_class = slab_class_of[div_roundup(size, 16ul)];
+	const bool shared = !cpu::smp::cpu_data_initialized();
+	Slab* slab = nullptr;
+
+	for(;;)
+	{
+		const SlabContext context = enter_slabs(shared);
+		SlabClass& cache = context.classes[size_class];
+		Slab* retired = nullptr;
+
+		// Objects freed remotely are only taken back once the local slabs run dry.
+		if((context.cache != nullptr) && (cache.partial == nullptr) &&
+		   (context.cache->remote_free.load(std::memory_order_relaxed) != nullptr))
+		{
+			drain_remote(*context.cache, retired);
+		}
+
+		if(slab != nullptr)
+		{
+			slab->owner = context.owner;
+			add_count(cache.slabs, 1);
+			push_slab(cache.partial, slab);
+		}
+
+		void* ret = take_object(cache, size_class);
+
+		leave_slabs(context);
+		destroy_slabs(retired);
+
+		if((ret != nullptr) || (slab != nullptr))
+		{
+			return ret;
+		}
+
+		slab = create_slab(size_class);
+
+		if(slab == nullptr)
+		{
+			return nullptr;
+		}
+	}
+}
+
+static void slab_free(Slab* slab, void* ptr)
+{
+	const SlabContext context = enter_slabs(slab->owner == SLAB_SHARED);
+	Slab* retired = nullptr;
+
+	if(slab->owner == context.owner)
+	{
+		put_object(context.classes[slab->size_class], slab, ptr, retired);
+	}
+	else
+	{
+		// The object itself links the list, so a remote free allocates nothing.
+		std::atomic<void*>& list = cpu::smp::get_cpu_data(slab->owner)->heap_cache.remote_free;
+		void* head = list.load(std::memory_order_relaxed);
+
+		do
+		{
+			*static_cast<void**>(ptr) = head;
+		} while(!list.compare_exchange_weak(head, ptr, std::memory_order_release,
+											std::memory_order_relaxed));
+
+		add_count(context.cache->remote_frees, 1);
+	}
+
+	leave_slabs(context);
+	destroy_slabs(retired);
+}
+
+static void* allocate(size_t size)
+{
+	return (size <= HEAP_SLAB_MAX) ? slab_allocate(size) : buddy_allocate(size, false);
+}
+
+static void release(void* ptr)
+{
+	Slab* slab = find_slab(ptr);
+
+	if(slab != nullptr)
+	{
+		slab_free(slab, ptr);
+		return;
+	}
+
+	HeapArena* arena = find_arena(ptr);
+
+	if(arena == nullptr)
+	{
+		log_error("%p is not a heap allocation", ptr);
+		return;
+	}
+
+	buddy_release(arena, ptr, 0);
+}
+
+// Whether an allocation of `size` bytes, already rounded up to `alignment`, is a slab object.
+// Slab objects are spaced by their size from the first cache line after the header, so a class
+// only works if both are multiples of the alignment.
+static bool slab_fits(size_t alignment, size_t size)
+{
+	return (size <= HEAP_SLAB_MAX) && ((slab_objects_offset % alignment) == 0) &&
+		   ((slab_sizes[slab_class_of[div_roundup(size, 16ul)]] % alignment) == 0);
+}
+
+// The size decides between slab and buddy block the same way the allocation did, so slab
+// objects don't need the arena lookup and the slab bitmap.
+static void release_sized(void* ptr, size_t alignment, size_t size)
+{
+	size = align_up(size, alignment);
+
+	if(slab_fits(alignment, size))
+	{
+		Slab* slab =
+			reinterpret_cast<Slab*>(align_down(reinterpret_cast<uintptr_t>(ptr), HEAP_SLAB_SIZE));
+
+#ifdef HEAP_CHECK_SIZED_FREE
+		if((find_slab(ptr) != slab) || (slab->size_class != slab_class_of[div_roundup(size, 16ul)]))
+		{
+			log_error("Sized free of %p with %lu bytes doesn't match its allocation", ptr, size);
+			return;
+		}
+#endif
+
+		slab_free(slab, ptr);
+		return;
+	}
+
+	HeapArena* arena = find_arena(ptr);
+
+	if(arena == nullptr)
+	{
+		log_error("%p is not a heap allocation", ptr);
+		return;
+	}
+
+	buddy_release(arena, ptr, size);
+}
+
 void heap_initialize()
 {
 	PhysicalMemoryStats stats = {};
@@ -28,14 +787,23 @@ void heap_initialize()
 
 	physical_get_status(&stats);
 
-	// one-sixteen of total memory should be enough for Heap
-	// Round off it to the nearest power of 2.
-	size_t arena_size = std::bit_ceil(stats.total_pages / 16);
-	heap_arena = virtual_allocate(arena_size);
+	// The heap starts with one arena and grows on demand, up to its high-water mark.
+	heap_limit_pages = std::max(stats.total_pages / HEAP_LIMIT_DIVISOR, HEAP_ARENA_PAGES);
 
-	buddy = buddy_embed(reinterpret_cast<uint8_t*>(heap_arena), arena_size * PAGE_SIZE);
+	if(!create_arena(HEAP_ARENA_PAGES))
+	{
+		log_panik("Could not map the first heap arena");
+	}
 
-	assert(buddy != nullptr);
+	for(size_t i = 0, size_class = 0; i <= (HEAP_SLAB_MAX / 16); i++)
+	{
+		while(slab_sizes[size_class] < (i * 16))
+		{
+			size_class++;
+		}
+
+		slab_class_of[i] = static_cast<uint8_t>(size_class);
+	}
 
 	log_end_intialization();
 }
@@ -47,8 +815,7 @@ void* heap_malloc(size_t size)
 		return nullptr;
 	}
 
-	lock::ScopedLock guard(heap_lock);
-	return buddy_malloc(buddy, size);
+	return allocate(size);
 }
 
 void* heap_calloc(size_t nmemb, size_t size)
@@ -58,8 +825,24 @@ void* heap_calloc(size_t nmemb, size_t size)
 		return nullptr;
 	}
 
-	lock::ScopedLock guard(heap_lock);
-	return buddy_calloc(buddy, nmemb, size);
+	if(nmemb > (SIZE_MAX / size))
+	{
+		return nullptr;
+	}
+
+	if((nmemb * size) > HEAP_SLAB_MAX)
+	{
+		return buddy_allocate(nmemb * size, true);
+	}
+
+	void* ret = slab_allocate(nmemb * size);
+
+	if(ret != nullptr)
+	{
+		memset(ret, 0, nmemb * size);
+	}
+
+	return ret;
 }
 
 void* heap_realloc(void* ptr, size_t size)
@@ -69,8 +852,55 @@ void* heap_realloc(void* ptr, size_t size)
 		return nullptr;
 	}
 
-	lock::ScopedLock guard(heap_lock);
-	return buddy_realloc(buddy, ptr, size, false);
+	Slab* slab = find_slab(ptr);
+	size_t old_size = 0;
+
+	if(slab != nullptr)
+	{
+		old_size = slab_sizes[slab->size_class];
+
+		// Staying in the same class keeps the object where it is.
+		if((size <= HEAP_SLAB_MAX) && (slab_class_of[div_roundup(size, 16ul)] == slab->size_class))
+		{
+			return ptr;
+		}
+	}
+	else
+	{
+		HeapArena* arena = find_arena(ptr);
+
+		if(arena == nullptr)
+		{
+			return nullptr;
+		}
+
+		if(size > HEAP_SLAB_MAX)
+		{
+			lock::ScopedLock guard(heap_lock);
+			void* ret = buddy_realloc(arena->buddy, ptr, size, false);
+
+			if(ret != nullptr)
+			{
+				return ret;
+			}
+		}
+
+		// The arena is too full, or the block moves to a slab. Small aligned allocations can
+		// live in buddy blocks as well, so the old size can't be told from the new one.
+		old_size = block_size(arena, ptr);
+	}
+
+	void* ret = allocate(size);
+
+	if(ret == nullptr)
+	{
+		return nullptr;
+	}
+
+	memcpy(ret, ptr, std::min(old_size, size));
+	release(ptr);
+
+	return ret;
 }
 
 void heap_free(void* ptr)
@@ -80,7 +910,299 @@ void heap_free(void* ptr)
 		return;
 	}
 
+	release(ptr);
+}
+
+void heap_get_status(HeapStats* status)
+{
 	lock::ScopedLock guard(heap_lock);
-	buddy_free(buddy, ptr);
+
+	status->arenas = arena_count;
+	status->arena_size = arena_pages * PAGE_SIZE;
+	status->peak_arena_size = peak_arena_pages * PAGE_SIZE;
+	status->limit = heap_limit_pages * PAGE_SIZE;
+	status->used_size = 0;
+
+	for(size_t i = 0; i < arena_slots; i++)
+	{
+		if(arenas[i].base != 0)
+		{
+			status->used_size += arenas[i].idle_free - buddy_arena_free_size(arenas[i].buddy);
+		}
+	}
+}
+
+void heap_free_sized(void* ptr, size_t size)
+{
+	if(ptr == nullptr)
+	{
+		return;
+	}
+
+	release_sized(ptr, 1, size);
+}
+
+void heap_free_aligned_sized(void* ptr, size_t alignment, size_t size)
+{
+	if(ptr == nullptr)
+	{
+		return;
+	}
+
+	release_sized(ptr, alignment, size);
+}
+
+void* heap_aligned_alloc(size_t alignment, size_t size)
+{
+	if((size == 0) || !std::has_single_bit(alignment) || (alignment > PAGE_SIZE_2MiB) ||
+	   (size > (SIZE_MAX - alignment)))
+	{
+		return nullptr;
+	}
+
+	size = align_up(size, alignment);
+
+	if(slab_fits(alignment, size))
+	{
+		return slab_allocate(size);
+	}
+
+	// Buddy blocks are aligned to their size within the arena, which is aligned to 2 MiB.
+	return buddy_allocate(size, false);
+}
+
+error_t heap_get_slab_status(size_t size_class, HeapSlabStats* status)
+{
+	if(size_class >= HEAP_SLAB_CLASSES)
+	{
+		return SYSTEM_ERR_INVALID_ARGS;
+	}
+
+	// Other CPUs keep allocating, so the per-CPU counts are only a snapshot.
+	status->object_size = slab_sizes[size_class];
+
+	{
+		lock::ScopedLock guard(shared_lock);
+
+		status->slabs = __atomic_load_n(&shared_classes[size_class].slabs, __ATOMIC_RELAXED);
+		status->used_objects =
+			__atomic_load_n(&shared_classes[size_class].used_objects, __ATOMIC_RELAXED);
+	}
+
+	for(size_t i = 0; cpu::smp::cpu_data_initialized() && (i < cpu::smp::get_cpu_count()); i++)
+	{
+		const SlabClass& cache = cpu::smp::get_cpu_data(i)->heap_cache.classes[size_class];
+
+		status->slabs += __atomic_load_n(&cache.slabs, __ATOMIC_RELAXED);
+		status->used_objects += __atomic_load_n(&cache.used_objects, __ATOMIC_RELAXED);
+	}
+
+	status->objects = status->slabs * slab_capacity(size_class);
+
+	return SYSTEM_OK;
+}
+
+void heap_dump_status()
+{
+	HeapStats heap = {};
+	heap_get_status(&heap);
+
+	log_info("Heap: %lu arenas, %lu KiB mapped (peak %lu KiB, limit %lu KiB), %lu KiB used",
+			 heap.arenas, heap.arena_size / 1024, heap.peak_arena_size / 1024, heap.limit / 1024,
+			 heap.used_size / 1024);
+
+	for(size_t i = 0; i < HEAP_SLAB_CLASSES; i++)
+	{
+		HeapSlabStats stats = {};
+		heap_get_slab_status(i, &stats);
+
+		if(stats.slabs == 0)
+		{
+			continue;
+		}
+
+		log_info("Slab %4lu B: %lu slabs, %lu of %lu objects used (%lu%%)", stats.object_size,
+				 stats.slabs, stats.used_objects, stats.objects,
+				 (stats.used_objects * 100) / stats.objects);
+	}
+
+	size_t remote_frees = 0;
+
+	for(size_t i = 0; cpu::smp::cpu_data_initialized() && (i < cpu::smp::get_cpu_count()); i++)
+	{
+		remote_frees +=
+			__atomic_load_n(&cpu::smp::get_cpu_data(i)->heap_cache.remote_frees, __ATOMIC_RELAXED);
+	}
+
+	log_info("Slab objects freed by a CPU other than their owner: %lu", remote_frees);
+}
+
+// Allocates and frees a mix of small sizes, keeping a window of objects alive so slabs fill
+// and drain instead of handing the same object back and forth.
+static void stress_heap()
+{
+	void* objects[HEAP_STRESS_WINDOW] = {};
+
+	for(size_t i = 0; i < HEAP_STRESS_OPERATIONS; i++)
+	{
+		void*& object = objects[i % HEAP_STRESS_WINDOW];
+
+		heap_free(object);
+		object = heap_malloc(16ul << (i % 8));
+	}
+
+	for(void* object : objects)
+	{
+		heap_free(object);
+	}
+}
+
+bool heap_idle_pending()
+{
+	if(!cpu::smp::cpu_data_initialized())
+	{
+		return false;
+	}
+
+	const HeapCache& cache = cpu::smp::get_cpu_data()->heap_cache;
+
+	return cache.benchmark_pending.load(std::memory_order_relaxed) ||
+		   (cache.remote_free.load(std::memory_order_relaxed) != nullptr);
+}
+
+bool heap_idle_work()
+{
+	if(!cpu::smp::cpu_data_initialized())
+	{
+		return false;
+	}
+
+	HeapCache& cache = cpu::smp::get_cpu_data()->heap_cache;
+
+	if(cache.benchmark_pending.exchange(false, std::memory_order_acquire))
+	{
+		stress_heap();
+		heap_benchmark_done++;
+
+		return true;
+	}
+
+	if(cache.remote_free.load(std::memory_order_relaxed) == nullptr)
+	{
+		return false;
+	}
+
+	const SlabContext context = enter_slabs(false);
+	Slab* retired = nullptr;
+	const size_t drained = drain_remote(*context.cache, retired);
+
+	leave_slabs(context);
+	destroy_slabs(retired);
+
+	return drained != 0;
+}
+
+void heap_benchmark_smp()
+{
+	const size_t self = cpu::smp::get_cpu_data()->id;
+
+	for(size_t cpus = 1; cpus <= cpu::smp::get_cpu_count(); cpus *= 2)
+	{
+		heap_benchmark_done = 0;
+
+		const size_t start_time = drivers::timers::get_time();
+		size_t started = 1;
+
+		// The calling CPU takes part in every round, the others in order of their ID.
+		for(size_t i = 0; (i < cpu::smp::get_cpu_count()) && (started < cpus); i++)
+		{
+			cpu::smp::PlatformCpuData* cpu_data = cpu::smp::get_cpu_data(i);
+
+			if((i == self) || !cpu_data->is_up)
+			{
+				continue;
+			}
+
+			cpu_data->heap_cache.benchmark_pending.store(true, std::memory_order_release);
+			cpu::smp::wake(i);
+			started++;
+		}
+
+		stress_heap();
+		heap_benchmark_done++;
+
+		while(heap_benchmark_done.load(std::memory_order_acquire) < started)
+		{
+			pause();
+		}
+
+		const size_t elapsed = std::max(drivers::timers::get_time() - start_time, 1ul);
+
+		log_info("Heap stress on %lu CPUs: %lu allocations/s", started,
+				 (started * HEAP_STRESS_OPERATIONS * 1000) / elapsed);
+	}
+}
+
+// Reads one word of every page, at a different cache line of each, so the walk is bound by the
+// TLB rather than by a few cache sets. Returns false if the misses couldn't be counted.
+static bool walk_pages(uintptr_t address, size_t count, uint64_t& misses, uint64_t& cycles)
+{
+	const bool counting = cpu::pmu::start(cpu::pmu::Event::DTLB_LOAD_MISS);
+	const uint64_t start_time = cpu::read_tsc();
+
+	for(size_t i = 0; i < HEAP_BENCHMARK_ROUNDS; i++)
+	{
+		for(size_t j = 0; j < count; j++)
+		{
+			*reinterpret_cast<volatile uint64_t*>(address + (j * PAGE_SIZE) + ((j % 64) * 64));
+		}
+	}
+
+	cycles = (cpu::read_tsc() - start_time) / HEAP_BENCHMARK_ROUNDS;
+	misses = counting ? (cpu::pmu::read() / HEAP_BENCHMARK_ROUNDS) : 0;
+
+	cpu::pmu::stop();
+	return counting;
+}
+
+void heap_benchmark_walk()
+{
+	const size_t count = std::min(arenas[0].pages, HEAP_BENCHMARK_PAGES);
+	// Only read, so every page maps the shared zero page and the walk costs no frames.
+	void* small_pages = virtual_reserve(count);
+	uint64_t misses[2] = {};
+	uint64_t cycles[2] = {};
+
+	if(small_pages == nullptr)
+	{
+		log_info("Heap walk benchmark skipped, out of address space");
+		return;
+	}
+
+	// Take the first touch faults before the timed walk.
+	for(size_t i = 0; i < count; i++)
+	{
+		*reinterpret_cast<volatile uint64_t*>(reinterpret_cast<uintptr_t>(small_pages) +
+											  (i * PAGE_SIZE));
+	}
+
+	// The arena is only read, so walking it under the buddy allocator's feet is harmless.
+	const bool counted =
+		walk_pages(arenas[0].base, count, misses[0], cycles[0]);
+	walk_pages(reinterpret_cast<uintptr_t>(small_pages), count, misses[1], cycles[1]);
+
+	virtual_release(small_pages, count);
+
+	if(!counted)
+	{
+		log_info("Heap walk over %lu pages: %lu cycles with the arena, %lu with 4 KiB pages "
+				 "(no dTLB miss counter)",
+				 count, cycles[0], cycles[1]);
+		return;
+	}
+
+	log_info("Heap walk over %lu pages: %lu dTLB misses and %lu cycles with the arena, %lu and "
+			 "%lu with 4 KiB pages",
+			 count, misses[0], cycles[0], misses[1], cycles[1]);
 }
-} // namespace memory
\ No newline at end of file
+} // namespace memory
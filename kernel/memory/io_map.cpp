@@ -0,0 +1,287 @@
+#include <logger.h>
+#include <lock.hpp>
+
+#include <memory/heap.hpp>
+#include <memory/memory.hpp>
+#include <memory/io_map.hpp>
+#include <memory/virtual.hpp>
+
+namespace memory
+{
+struct IoMapping
+{
+	uintptr_t physical_address;
+	uintptr_t virtual_address;
+	size_t count;
+	size_t flags;
+	size_t refcount;
+
+	IoMapping* next_physical;
+	IoMapping* next_virtual;
+
+	// Unused mappings, oldest first.
+	IoMapping* prev_unused;
+	IoMapping* next_unused;
+};
+
+static lock::mutex io_lock;
+
+static IoMapping* physical_buckets[IO_MAP_BUCKETS];
+static IoMapping* virtual_buckets[IO_MAP_BUCKETS];
+
+static IoMapping* unused_head = nullptr;
+static IoMapping* unused_tail = nullptr;
+
+static IoMapStats io_stats = {};
+
+static size_t bucket(uintptr_t address)
+{
+	return (address / PAGE_SIZE) % IO_MAP_BUCKETS;
+}
+
+static void unlink(IoMapping** chain, IoMapping* mapping, IoMapping* IoMapping::*next)
+{
+	while(*chain != mapping)
+	{
+		chain = &((*chain)->*next);
+	}
+
+	*chain = mapping->*next;
+}
+
+static void push_unused(IoMapping* mapping)
+{
+	mapping->prev_unused = unused_tail;
+	mapping->next_unused = nullptr;
+
+	if(unused_tail != nullptr)
+	{
+		unused_tail->next_unused = mapping;
+	}
+	else
+	{
+		unused_head = mapping;
+	}
+
+	unused_tail = mapping;
+	io_stats.unused_mappings++;
+}
+
+static void remove_unused(IoMapping* mapping)
+{
+	if(mapping->prev_unused != nullptr)
+	{
+		mapping->prev_unused->next_unused = mapping->next_unused;
+	}
+	else
+	{
+		unused_head = mapping->next_unused;
+	}
+
+	if(mapping->next_unused != nullptr)
+	{
+		mapping->next_unused->prev_unused = mapping->prev_unused;
+	}
+	else
+	{
+		unused_tail = mapping->prev_unused;
+	}
+
+	io_stats.unused_mappings--;
+}
+
+// A mapping starting at the same page with the same flags serves any request it covers.
+static IoMapping* find_physical(uintptr_t physical_address, size_t count, size_t flags)
+{
+	for(IoMapping* mapping = physical_buckets[bucket(physical_address)]; mapping != nullptr;
+		mapping = mapping->next_physical)
+	{
+		if((mapping->physical_address == physical_address) && (mapping->flags == flags) &&
+		   (mapping->count >= count))
+		{
+			return mapping;
+		}
+	}
+
+	return nullptr;
+}
+
+static IoMapping* find_virtual(uintptr_t virtual_address)
+{
+	for(IoMapping* mapping = virtual_buckets[bucket(virtual_address)]; mapping != nullptr;
+		mapping = mapping->next_virtual)
+	{
+		if(mapping->virtual_address == virtual_address)
+		{
+			return mapping;
+		}
+	}
+
+	return nullptr;
+}
+
+static void get_mapping(IoMapping* mapping)
+{
+	if(mapping->refcount++ == 0)
+	{
+		remove_unused(mapping);
+	}
+}
+
+// Takes the oldest unused mapping out of the tables once there are too many of them. It is
+// torn down by the caller, after dropping the lock.
+static IoMapping* evict()
+{
+	IoMapping* mapping = unused_head;
+
+	if((io_stats.unused_mappings <= IO_MAP_CACHE_SIZE) || (mapping == nullptr))
+	{
+		return nullptr;
+	}
+
+	remove_unused(mapping);
+	unlink(&physical_buckets[bucket(mapping->physical_address)], mapping,
+		   &IoMapping::next_physical);
+	unlink(&virtual_buckets[bucket(mapping->virtual_address)], mapping,
+		   &IoMapping::next_virtual);
+
+	io_stats.mappings--;
+	io_stats.evictions++;
+
+	return mapping;
+}
+
+static void destroy(IoMapping* mapping)
+{
+	if(mapping == nullptr)
+	{
+		return;
+	}
+
+	virtual_free_at(reinterpret_cast<void*>(mapping->virtual_address), mapping->count);
+	heap_free(mapping);
+}
+
+void* io_map(uintptr_t physical_address, size_t size, size_t flags)
+{
+	const uintptr_t page = align_down(physical_address, PAGE_SIZE);
+	const size_t offset = physical_address - page;
+	const size_t count = div_roundup(offset + size, PAGE_SIZE);
+
+	void* direct = virtual_direct_map(physical_address, size);
+
+	if(direct != nullptr)
+	{
+		__atomic_fetch_add(&io_stats.direct, 1, __ATOMIC_RELAXED);
+		return direct;
+	}
+
+	{
+		lock::ScopedLock guard(io_lock);
+
+		IoMapping* mapping = find_physical(page, count, flags);
+
+		if(mapping != nullptr)
+		{
+			get_mapping(mapping);
+			io_stats.hits++;
+
+			return reinterpret_cast<uint8_t*>(mapping->virtual_address) + offset;
+		}
+
+		io_stats.misses++;
+	}
+
+	// Mapping needs the page table and heap locks, so it happens outside of the cache lock.
+	IoMapping* mapping = static_cast<IoMapping*>(heap_malloc(sizeof(IoMapping)));
+	void* virtual_address = virtual_allocate_at(page, count, flags);
+
+	if((mapping == nullptr) || (virtual_address == nullptr))
+	{
+		if(virtual_address != nullptr)
+		{
+			virtual_free_at(virtual_address, count);
+		}
+
+		heap_free(mapping);
+		return nullptr;
+	}
+
+	*mapping = {};
+	mapping->physical_address = page;
+	mapping->virtual_address = reinterpret_cast<uintptr_t>(virtual_address);
+	mapping->count = count;
+	mapping->flags = flags;
+	mapping->refcount = 1;
+
+	IoMapping* victim = nullptr;
+	uintptr_t ret = 0;
+
+	{
+		lock::ScopedLock guard(io_lock);
+
+		// Another CPU may have mapped the same range meanwhile, its mapping wins.
+		IoMapping* existing = find_physical(page, count, flags);
+
+		if(existing != nullptr)
+		{
+			get_mapping(existing);
+			victim = mapping;
+			ret = existing->virtual_address;
+		}
+		else
+		{
+			mapping->next_physical = physical_buckets[bucket(page)];
+			physical_buckets[bucket(page)] = mapping;
+
+			mapping->next_virtual = virtual_buckets[bucket(mapping->virtual_address)];
+			virtual_buckets[bucket(mapping->virtual_address)] = mapping;
+
+			io_stats.mappings++;
+			ret = mapping->virtual_address;
+		}
+	}
+
+	destroy(victim);
+	return reinterpret_cast<uint8_t*>(ret) + offset;
+}
+
+void io_unmap(void* ptr, size_t size)
+{
+	const uintptr_t virtual_address = align_down(reinterpret_cast<uintptr_t>(ptr), PAGE_SIZE);
+	IoMapping* victim = nullptr;
+
+	{
+		lock::ScopedLock guard(io_lock);
+
+		IoMapping* mapping = find_virtual(virtual_address);
+
+		if(mapping == nullptr)
+		{
+			if(virtual_direct_map(from_higher_half(reinterpret_cast<uintptr_t>(ptr)), size) !=
+			   ptr)
+			{
+				log_error("0x%.16lx is not an I/O mapping", reinterpret_cast<uintptr_t>(ptr));
+			}
+
+			return;
+		}
+
+		// The mapping stays in the tables, the next io_map of the range can take it back.
+		if(--mapping->refcount == 0)
+		{
+			push_unused(mapping);
+			victim = evict();
+		}
+	}
+
+	destroy(victim);
+}
+
+void io_map_get_status(IoMapStats* status)
+{
+	lock::ScopedLock guard(io_lock);
+
+	*status = io_stats;
+}
+} // namespace memory
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <assert.h>
 #include <logger.h>
 
 #include <algorithm>
@@ -6,20 +7,179 @@
 #include <memory/physical.hpp>
 #include <memory/memory.hpp>
 
-#include <libs/bitmap.hpp>
+#include <cpu/smp.hpp>
+#include <cpu/arch_smp.hpp>
+#include <cpu/cpu.hpp>
+
+#include <drivers/acpi.hpp>
+
+#include <libs/summary_bitmap.hpp>
+#include <libs/vector.hpp>
 #include <lock.hpp>
 
+// Memory below 4 GiB, reachable by devices limited to 32-bit DMA.
+#define DMA32_PAGE_LIMIT (0x100000000UL / PAGE_SIZE)
+
+// Maximum number of ranges, across all nodes and zones.
+#define PHYS_MAX_RANGES 32
+
+// Flags of the SRAT affinity structures.
+#define SRAT_PROCESSOR_ENABLED (1 << 0)
+#define SRAT_MEMORY_ENABLED (1 << 0)
+
+// Frames of the scratch bitmap physical_benchmark_allocate searches, as many as 16 GiB have, and
+// the allocations it times per fill level and scanner.
+#define PHYS_BENCHMARK_FRAMES (1ul << 22)
+#define PHYS_BENCHMARK_ROUNDS 4096
+
 namespace memory
 {
+// A range of page frames belonging to a single node and zone.
+struct PhysicalRange
+{
+	size_t start;
+	size_t end;
+	size_t node;
+	bool dma32;
+
+	// Searches continue where the previous allocation from this range ended.
+	size_t last_index;
+};
+
+struct ZeroPool
+{
+	uintptr_t frames[ZERO_POOL_SIZE];
+	size_t count;
+};
+
+struct PhysicalNode
+{
+	uint32_t proximity_domain;
+
+	// Every node, ordered by distance from this one. The node itself comes first.
+	size_t fallback[PHYS_MAX_NODES];
+
+	size_t spanned_pages;
+	size_t free_pages;
+
+	// Frames zeroed by idle CPUs of this node, handed out before zeroing on allocation.
+	ZeroPool zero_pool;
+};
+
 PhysicalMemoryStats phys_stats = {};
-Bitmap phys_bitmap = {};
+SummaryBitmap phys_bitmap = {};
+PageFrame* phys_frames = nullptr;
 lock::mutex phys_lock = {};
-size_t bitmap_last_index = 0;
+
+PhysicalRange phys_ranges[PHYS_MAX_RANGES] = {};
+size_t phys_range_count = 0;
+PhysicalNode phys_nodes[PHYS_MAX_NODES] = {};
+size_t phys_node_count = 0;
+
+// Allocator activity before per-CPU data is available.
+PhysicalCpuStats boot_telemetry = {};
+
+// The counters are only touched atomically. Pool counts change under zero_pool_lock, but with
+// atomic stores, since allocations and idle CPUs peek at them without the lock.
+size_t zero_pool_hits = 0;
+size_t zero_pool_misses = 0;
+lock::mutex zero_pool_lock = {};
+
+// Adds the frames [start, end) to `node`, split at the DMA32 boundary.
+static void add_range(size_t node, size_t start, size_t end)
+{
+	end = std::min(end, phys_bitmap.size());
+
+	while(start < end)
+	{
+		if(phys_range_count == PHYS_MAX_RANGES)
+		{
+			log_warning("Too many physical memory ranges, ignoring 0x%lx-0x%lx", start * PAGE_SIZE,
+						end * PAGE_SIZE);
+			return;
+		}
+
+		const bool dma32 = (start < DMA32_PAGE_LIMIT);
+		const size_t limit = dma32 ? std::min(end, DMA32_PAGE_LIMIT) : end;
+
+		phys_ranges[phys_range_count++] = {start, limit, node, dma32, start};
+		phys_nodes[node].spanned_pages += (limit - start);
+
+		start = limit;
+	}
+}
+
+static PhysicalRange* range_of(size_t page)
+{
+	for(size_t i = 0; i < phys_range_count; i++)
+	{
+		if((page >= phys_ranges[i].start) && (page < phys_ranges[i].end))
+		{
+			return &phys_ranges[i];
+		}
+	}
+
+	return nullptr;
+}
+
+static size_t node_of(size_t page)
+{
+	const PhysicalRange* range = range_of(page);
+	return (range != nullptr) ? range->node : 0;
+}
+
+static size_t local_node()
+{
+	return cpu::smp::cpu_data_initialized() ? cpu::smp::get_cpu_data()->numa_node : 0;
+}
+
+// The node requested through the flags, or the local node of the calling CPU.
+static size_t preferred_node(uint32_t flags)
+{
+	const size_t node = (flags >> PHYS_ALLOC_NODE_SHIFT);
+
+	if((node != 0) && (node <= phys_node_count))
+	{
+		return node - 1;
+	}
+
+	return local_node();
+}
+
+// Takes `size` bytes off the start of the first usable entry that is large enough.
+static uintptr_t carve_usable_memory(size_t size)
+{
+	const size_t memmap_count = memmap_request.response->entry_count;
+	limine_memmap_entry** memmaps = memmap_request.response->entries;
+
+	for(size_t i = 0; i < memmap_count; i++)
+	{
+		if((memmaps[i]->type != LIMINE_MEMMAP_USABLE) || (memmaps[i]->length < size))
+		{
+			continue;
+		}
+
+		const uintptr_t ret = memmaps[i]->base;
+
+		memmaps[i]->length -= size;
+		memmaps[i]->base += size;
+
+		phys_stats.used_pages += div_roundup(size, PAGE_SIZE);
+
+		return ret;
+	}
+
+	log_panik("No usable memory range can hold 0x%lx bytes", size);
+}
 
 void physical_initialize()
 {
 	const size_t memmap_count = memmap_request.response->entry_count;
 	limine_memmap_entry** memmaps = memmap_request.response->entries;
+	const uint64_t start_time = cpu::read_tsc();
+
+	// Bootloader-reclaimable memory is freed later on, so the bitmap has to cover it too.
+	uintptr_t highest_tracked_addr = 0;
 
 	log_begin_intialization("Physical Memory Manager");
 
@@ -37,8 +197,10 @@ void physical_initialize()
 				// Guaranteed to be page-aligned
 				phys_stats.usable_pages += (memmaps[i]->length / PAGE_SIZE);
 				break;
-			case LIMINE_MEMMAP_KERNEL_AND_MODULES:
 			case LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE:
+				highest_tracked_addr = std::max(highest_tracked_addr, limit);
+				break;
+			case LIMINE_MEMMAP_KERNEL_AND_MODULES:
 				break;
 			default:
 				continue;
@@ -54,30 +216,21 @@ void physical_initialize()
 		phys_stats.lowest_usable_addr = 0x1000;
 	}
 
-	size_t bitmap_entries = phys_stats.highest_usable_addr / PAGE_SIZE;
-	size_t bitmap_size = align_up(bitmap_entries / 8, PAGE_SIZE);
-	bitmap_entries = bitmap_size * 8;
+	highest_tracked_addr = std::max(highest_tracked_addr, phys_stats.highest_usable_addr);
 
-	for(size_t i = 0; i < memmap_count; i++)
-	{
-		if(memmaps[i]->type != LIMINE_MEMMAP_USABLE)
-		{
-			continue;
-		}
+	const size_t bitmap_entries = highest_tracked_addr / PAGE_SIZE;
+	const size_t bitmap_size = align_up(SummaryBitmap::storage_size(bitmap_entries), PAGE_SIZE);
+	const size_t frames_size = align_up(bitmap_entries * sizeof(PageFrame), PAGE_SIZE);
 
-		if(memmaps[i]->length >= bitmap_size)
-		{
-			phys_bitmap.initialize(reinterpret_cast<uint8_t*>(to_higher_half(memmaps[i]->base)),
-								   bitmap_entries);
-			memset(phys_bitmap.buffer(), 0xff, bitmap_entries);
+	const uintptr_t bitmap_base = carve_usable_memory(bitmap_size);
+	const uintptr_t frames_base = carve_usable_memory(frames_size);
 
-			memmaps[i]->length -= bitmap_size;
-			memmaps[i]->base += bitmap_size;
+	phys_bitmap.initialize(to_higher_half(reinterpret_cast<uint64_t*>(bitmap_base)),
+						   bitmap_entries);
 
-			phys_stats.used_pages += div_roundup(bitmap_size, PAGE_SIZE);
-			break;
-		}
-	}
+	// One descriptor per tracked frame, so reclaimed memory has descriptors too.
+	phys_frames = to_higher_half(reinterpret_cast<PageFrame*>(frames_base));
+	memset(phys_frames, 0, frames_size);
 
 	for(size_t i = 0; i < memmap_count; i++)
 	{
@@ -86,17 +239,23 @@ void physical_initialize()
 			continue;
 		}
 
-		for(uintptr_t j = 0; j < memmaps[i]->length; j += PAGE_SIZE)
-		{
-			phys_bitmap[(memmaps[i]->base + j) / PAGE_SIZE] = BITMAP_FREE;
-		}
+		phys_bitmap.clear_range(memmaps[i]->base / PAGE_SIZE,
+								(memmaps[i]->base + memmaps[i]->length) / PAGE_SIZE);
 	}
 
 	phys_stats.free_pages = phys_stats.usable_pages - phys_stats.used_pages;
 
+	// Until the SRAT has been read, all memory belongs to one node.
+	phys_node_count = 1;
+	phys_nodes[0].fallback[0] = 0;
+	add_range(0, 0, phys_bitmap.size());
+	phys_nodes[0].free_pages = phys_stats.free_pages;
+
 	log_end_intialization();
 
+	log_debug("Initialized in %lu TSC cycles", cpu::read_tsc() - start_time);
 	log_debug("Bitmap size = %lu (%lu KiB)", bitmap_size, bitmap_size / 1024);
+	log_debug("Frame descriptors size = %lu (%lu KiB)", frames_size, frames_size / 1024);
 	log_debug("Lowest usable address = 0x%.16lx", phys_stats.lowest_usable_addr);
 	log_debug("Highest usable address = 0x%.16lx", phys_stats.highest_usable_addr);
 	log_debug("Highest physical address = 0x%.16lx", phys_stats.highest_physical_addr);
@@ -112,84 +271,1241 @@ void physical_initialize()
 void physical_get_status(PhysicalMemoryStats* dest)
 {
 	memcpy(dest, &phys_stats, sizeof(PhysicalMemoryStats));
+
+	if(!cpu::smp::cpu_data_initialized())
+	{
+		return;
+	}
+
+	// Frames sitting in zero pools and CPU caches are taken from the bitmap, but still free.
+	for(size_t i = 0; i < phys_node_count; i++)
+	{
+		const size_t zeroed = __atomic_load_n(&phys_nodes[i].zero_pool.count, __ATOMIC_RELAXED);
+
+		dest->used_pages -= zeroed;
+		dest->free_pages += zeroed;
+	}
+
+	for(size_t i = 0; i < cpu::smp::get_cpu_count(); i++)
+	{
+		const size_t cached =
+			__atomic_load_n(&cpu::smp::get_cpu_data(i)->frame_cache.count, __ATOMIC_RELAXED);
+
+		dest->used_pages -= cached;
+		dest->free_pages += cached;
+	}
 }
 
-void* physical_allocate(size_t count)
+error_t physical_get_cache_status(size_t cpu, FrameCacheStats* dest)
 {
-	if(count == 0)
+	if(!cpu::smp::cpu_data_initialized())
 	{
-		return nullptr;
+		return SYSTEM_ERR_BAD_STATE;
+	}
+
+	if(cpu >= cpu::smp::get_cpu_count())
+	{
+		return SYSTEM_ERR_OUT_OF_RANGE;
+	}
+
+	const FrameCache& cache = cpu::smp::get_cpu_data(cpu)->frame_cache;
+
+	dest->cached_pages = __atomic_load_n(&cache.count, __ATOMIC_RELAXED);
+	dest->hits = __atomic_load_n(&cache.hits, __ATOMIC_RELAXED);
+	dest->misses = __atomic_load_n(&cache.misses, __ATOMIC_RELAXED);
+
+	return SYSTEM_OK;
+}
+
+void physical_get_zero_pool_status(ZeroPoolStats* dest)
+{
+	lock::ScopedLock guard(zero_pool_lock);
+
+	dest->zeroed_pages = 0;
+	dest->hits = __atomic_load_n(&zero_pool_hits, __ATOMIC_RELAXED);
+	dest->misses = __atomic_load_n(&zero_pool_misses, __ATOMIC_RELAXED);
+
+	for(size_t i = 0; i < phys_node_count; i++)
+	{
+		dest->zeroed_pages += phys_nodes[i].zero_pool.count;
+	}
+}
+
+size_t physical_get_node_count()
+{
+	return phys_node_count;
+}
+
+error_t physical_get_node_status(size_t node, PhysicalNodeStats* dest)
+{
+	if(node >= phys_node_count)
+	{
+		return SYSTEM_ERR_OUT_OF_RANGE;
 	}
 
 	lock::ScopedLock guard(phys_lock);
 
-	auto allocate_internal = [count](size_t limit) -> void* {
-		size_t i = 0;
+	dest->proximity_domain = phys_nodes[node].proximity_domain;
+	dest->spanned_pages = phys_nodes[node].spanned_pages;
+	dest->free_pages = phys_nodes[node].free_pages;
+
+	return SYSTEM_OK;
+}
 
-		while(bitmap_last_index < limit)
+// Must be called with `phys_lock` held. Walks the ranges of `node`, taking normal memory
+// before DMA32 memory, until `find` returns a page.
+template<typename F>
+static size_t search_node(size_t node, uint32_t flags, F find)
+{
+	for(int dma32 = (flags & PHYS_ALLOC_DMA32) ? 1 : 0; dma32 < 2; dma32++)
+	{
+		for(size_t i = 0; i < phys_range_count; i++)
 		{
-			if(phys_bitmap[bitmap_last_index++] == BITMAP_FREE)
+			PhysicalRange& range = phys_ranges[i];
+
+			if((range.node != node) || (range.dma32 != (dma32 == 1)))
 			{
-				if(++i == count)
-				{
-					size_t page = bitmap_last_index - count;
+				continue;
+			}
 
-					for(size_t j = page; j < bitmap_last_index; j++)
-					{
-						phys_bitmap[j] = BITMAP_USED;
-					}
+			const size_t page = find(range);
 
-					return reinterpret_cast<void*>(page * PAGE_SIZE);
-				}
-			}
-			else
+			if(page != SummaryBitmap::npos)
 			{
-				i = 0;
+				return page;
 			}
 		}
+	}
 
-		return nullptr;
-	};
-
-	size_t index = bitmap_last_index;
-	void* ret = allocate_internal(phys_stats.highest_usable_addr / PAGE_SIZE);
+	return SummaryBitmap::npos;
+}
 
-	if(ret == nullptr)
+// Must be called with `phys_lock` held. Like search_node, but walks the nodes by distance
+// from `node`.
+template<typename F>
+static size_t search_nodes(size_t node, uint32_t flags, F find)
+{
+	for(size_t i = 0; i < phys_node_count; i++)
 	{
-		bitmap_last_index = 0;
-		ret = allocate_internal(index);
+		const size_t page = search_node(phys_nodes[node].fallback[i], flags, find);
 
-		// Try swapping pages
-		if(ret == nullptr)
+		if(page != SummaryBitmap::npos)
 		{
-			log_panik("Out of Phyiscal Memory!");
+			return page;
 		}
 	}
 
-	memset(to_higher_half(ret), 0, count * PAGE_SIZE);
+	return SummaryBitmap::npos;
+}
+
+// Must be called with `phys_lock` held.
+static void mark_used(size_t page, size_t count)
+{
+	phys_bitmap.set_range(page, page + count);
+
+	phys_nodes[node_of(page)].free_pages -= count;
+
 	phys_stats.used_pages += count;
 	phys_stats.free_pages -= count;
+}
 
-	return ret;
+// Must be called with `phys_lock` held.
+static void free_pages(size_t page, size_t count)
+{
+	phys_bitmap.clear_range(page, page + count);
+
+	phys_nodes[node_of(page)].free_pages += count;
+
+	phys_stats.used_pages -= count;
+	phys_stats.free_pages += count;
 }
 
-void physical_free(void* ptr, size_t count)
+static void record_latency(bool allocate, uint64_t start_time)
 {
-	if(ptr == nullptr)
+	const uint64_t cycles = cpu::read_tsc() - start_time;
+
+	// Counters are per CPU and only approximate if an interrupt allocates in between.
+	PhysicalCpuStats& stats = cpu::smp::cpu_data_initialized() ?
+								  cpu::smp::get_cpu_data()->phys_telemetry :
+								  boot_telemetry;
+
+	size_t bucket = (cycles == 0) ? 0 : (63 - static_cast<size_t>(__builtin_clzll(cycles)));
+	bucket = std::min<size_t>(bucket, PHYS_HISTOGRAM_BUCKETS - 1);
+
+	if(allocate)
 	{
-		return;
+		stats.allocations++;
+		stats.allocate_latency[bucket]++;
+	}
+	else
+	{
+		stats.frees++;
+		stats.free_latency[bucket]++;
+	}
+}
+
+// Upper bound of the histogram bucket that holds the given percentile.
+static uint64_t get_percentile(const size_t* histogram, size_t total, size_t percent)
+{
+	const size_t target = ((total * percent) + 99) / 100;
+	size_t seen = 0;
+
+	for(size_t i = 0; (i < PHYS_HISTOGRAM_BUCKETS) && (total != 0); i++)
+	{
+		seen += histogram[i];
+
+		if(seen >= target)
+		{
+			return 2ull << i;
+		}
+	}
+
+	return 0;
+}
+
+// Must be called with `phys_lock` held.
+static void collect_telemetry(PhysicalTelemetry* dest)
+{
+	PhysicalCpuStats totals = boot_telemetry;
+
+	memset(dest, 0, sizeof(PhysicalTelemetry));
+
+	for(size_t i = 0; cpu::smp::cpu_data_initialized() && (i < cpu::smp::get_cpu_count()); i++)
+	{
+		const PhysicalCpuStats& stats = cpu::smp::get_cpu_data(i)->phys_telemetry;
+
+		totals.allocations += stats.allocations;
+		totals.frees += stats.frees;
+
+		for(size_t j = 0; j < PHYS_HISTOGRAM_BUCKETS; j++)
+		{
+			totals.allocate_latency[j] += stats.allocate_latency[j];
+			totals.free_latency[j] += stats.free_latency[j];
+		}
+	}
+
+	dest->allocations = totals.allocations;
+	dest->frees = totals.frees;
+	dest->allocate_p50 = get_percentile(totals.allocate_latency, totals.allocations, 50);
+	dest->allocate_p90 = get_percentile(totals.allocate_latency, totals.allocations, 90);
+	dest->allocate_p99 = get_percentile(totals.allocate_latency, totals.allocations, 99);
+	dest->free_p50 = get_percentile(totals.free_latency, totals.frees, 50);
+	dest->free_p90 = get_percentile(totals.free_latency, totals.frees, 90);
+	dest->free_p99 = get_percentile(totals.free_latency, totals.frees, 99);
+
+	// Frames in zero pools and CPU caches show up as used here.
+	size_t page = phys_bitmap.find_clear(0, phys_bitmap.size());
+
+	while(page != SummaryBitmap::npos)
+	{
+		size_t end = phys_bitmap.find_set(page, phys_bitmap.size());
+		end = (end == SummaryBitmap::npos) ? phys_bitmap.size() : end;
+
+		const size_t run = end - page;
+		const size_t bucket = 63 - static_cast<size_t>(__builtin_clzll(run));
+
+		dest->free_runs[std::min<size_t>(bucket, PHYS_HISTOGRAM_BUCKETS - 1)]++;
+		dest->largest_free_run = std::max(dest->largest_free_run, run);
+
+		page = phys_bitmap.find_clear(end, phys_bitmap.size());
+	}
+}
+
+static void log_telemetry(const PhysicalTelemetry& telemetry)
+{
+	log_info("Free memory = %lu pages, largest free run = %lu pages", phys_stats.free_pages,
+			 telemetry.largest_free_run);
+
+	for(size_t i = 0; i < PHYS_HISTOGRAM_BUCKETS; i++)
+	{
+		if(telemetry.free_runs[i] != 0)
+		{
+			log_info("Free runs of %lu-%lu pages = %lu", 1ul << i, (2ul << i) - 1,
+					 telemetry.free_runs[i]);
+		}
 	}
 
+	log_info("Allocations = %lu (p50 < %lu, p90 < %lu, p99 < %lu cycles)", telemetry.allocations,
+			 telemetry.allocate_p50, telemetry.allocate_p90, telemetry.allocate_p99);
+	log_info("Frees = %lu (p50 < %lu, p90 < %lu, p99 < %lu cycles)", telemetry.frees,
+			 telemetry.free_p50, telemetry.free_p90, telemetry.free_p99);
+}
+
+void physical_get_telemetry(PhysicalTelemetry* dest)
+{
 	lock::ScopedLock guard(phys_lock);
+	collect_telemetry(dest);
+}
+
+void physical_dump_telemetry()
+{
+	PhysicalTelemetry telemetry = {};
 
-	size_t page = reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE;
+	physical_get_telemetry(&telemetry);
+	log_telemetry(telemetry);
+}
+
+// Must be called with `phys_lock` held.
+__NO_RETURN static void out_of_memory()
+{
+	PhysicalTelemetry telemetry = {};
+
+	collect_telemetry(&telemetry);
+	log_telemetry(telemetry);
+
+	log_panik("Out of Phyiscal Memory!");
+}
+
+// Must be called with `phys_lock` held. Hands the zeroed frames of every node back to the bitmap.
+static size_t drain_zero_pools()
+{
+	lock::ScopedLock guard(zero_pool_lock);
+	size_t drained = 0;
 
-	for(size_t i = page; i < (page + count); i++)
+	for(size_t i = 0; i < phys_node_count; i++)
 	{
-		phys_bitmap[i] = BITMAP_FREE;
+		ZeroPool& pool = phys_nodes[i].zero_pool;
+
+		for(size_t j = 0; j < pool.count; j++)
+		{
+			free_pages(pool.frames[j] / PAGE_SIZE, 1);
+		}
+
+		drained += pool.count;
+		__atomic_store_n(&pool.count, 0, __ATOMIC_RELAXED);
 	}
 
-	phys_stats.used_pages -= count;
-	phys_stats.free_pages += count;
+	return drained;
+}
+
+// Must be called with `phys_lock` held. Zero pools and CPU caches only serve single frames of
+// their own node, so before an allocation fails, their frames go back to the bitmap where runs,
+// DMA32 and remote requests can use them. Returns the number of frames handed back.
+static size_t reclaim_parked_frames()
+{
+	size_t reclaimed = drain_zero_pools();
+
+	for(size_t i = 0; cpu::smp::cpu_data_initialized() && (i < cpu::smp::get_cpu_count()); i++)
+	{
+		FrameCache& cache = cpu::smp::get_cpu_data(i)->frame_cache;
+		lock::ScopedLock guard(cache.lock);
+
+		for(size_t j = 0; j < cache.count; j++)
+		{
+			free_pages(cache.frames[j] / PAGE_SIZE, 1);
+		}
+
+		reclaimed += cache.count;
+		__atomic_store_n(&cache.count, 0, __ATOMIC_RELAXED);
+	}
+
+	if(reclaimed != 0)
+	{
+		log_warning("Low on memory, took %lu frames back from zero pools and CPU caches",
+					reclaimed);
+	}
+
+	return reclaimed;
+}
+
+// Must be called with `phys_lock` held. Finds `count` free frames within `range`, continuing
+// where the previous search ended.
+static size_t find_pages(PhysicalRange& range, size_t count)
+{
+	auto allocate_internal = [count](size_t start, size_t limit) -> size_t {
+		if(count == 1)
+		{
+			return phys_bitmap.find_clear(start, limit);
+		}
+
+		return phys_bitmap.find_clear_run(count, start, limit);
+	};
+
+	size_t page = allocate_internal(range.last_index, range.end);
+
+	if(page == SummaryBitmap::npos)
+	{
+		// Wrap around; a run may also straddle the previous index.
+		page = allocate_internal(range.start, std::min(range.last_index + count, range.end));
+	}
+
+	if(page != SummaryBitmap::npos)
+	{
+		range.last_index = page + count;
+	}
+
+	return page;
+}
+
+// Must be called with `phys_lock` held.
+static size_t allocate_pages(size_t count, size_t node, uint32_t flags)
+{
+	auto find = [count](PhysicalRange& range) { return find_pages(range, count); };
+	size_t page = search_nodes(node, flags, find);
+
+	if((page == SummaryBitmap::npos) && (reclaim_parked_frames() != 0))
+	{
+		page = search_nodes(node, flags, find);
+	}
+
+	// Try swapping pages
+	if(page == SummaryBitmap::npos)
+	{
+		out_of_memory();
+	}
+
+	mark_used(page, count);
+
+	return page;
+}
+
+// Must be called with `phys_lock` held. Fills `frames` with `count` frames that don't have
+// to be contiguous, taking whole runs of free frames at once where there are any.
+static void allocate_pages_bulk(void** frames, size_t count, size_t node, uint32_t flags)
+{
+	size_t allocated = 0;
+
+	while(allocated < count)
+	{
+		size_t run = 0;
+
+		const size_t page = search_nodes(node, flags, [&](PhysicalRange& range) -> size_t {
+			size_t found = phys_bitmap.find_clear(range.last_index, range.end);
+
+			if(found == SummaryBitmap::npos)
+			{
+				found = phys_bitmap.find_clear(range.start, range.end);
+			}
+
+			if(found == SummaryBitmap::npos)
+			{
+				return found;
+			}
+
+			run = 1;
+
+			while((run < (count - allocated)) && ((found + run) < range.end) &&
+				  !phys_bitmap.test(found + run))
+			{
+				run++;
+			}
+
+			range.last_index = found + run;
+
+			return found;
+		});
+
+		if((page == SummaryBitmap::npos) && (reclaim_parked_frames() != 0))
+		{
+			continue;
+		}
+
+		// Try swapping pages
+		if(page == SummaryBitmap::npos)
+		{
+			out_of_memory();
+		}
+
+		mark_used(page, run);
+
+		for(size_t i = 0; i < run; i++)
+		{
+			frames[allocated++] = reinterpret_cast<void*>((page + i) * PAGE_SIZE);
+		}
+	}
+}
+
+// Must be called with `phys_lock` held.
+static size_t allocate_aligned_pages(size_t count, size_t align, size_t node, uint32_t flags)
+{
+	const size_t page = search_nodes(node, flags, [count, align](PhysicalRange& range) {
+		return phys_bitmap.find_clear_aligned(count, align, range.start, range.end);
+	});
+
+	if(page != SummaryBitmap::npos)
+	{
+		mark_used(page, count);
+	}
+
+	return page;
+}
+
+// Takes a frame from the local CPU cache, refilling it in one batch when it runs empty.
+// Only the owning CPU fills and drains its cache, with interrupts disabled. The cache lock only
+// keeps it consistent while a failing allocation hands the frames back to the bitmap.
+// The refill only takes frames of the local node, as many as it finds. Returns 0 when the
+// node has none left, so the caller can fall back to the other nodes.
+static uintptr_t cache_allocate()
+{
+	const bool interrupts = arch::interrupt_status();
+	disable_interrupts();
+
+	FrameCache& cache = cpu::smp::get_cpu_data()->frame_cache;
+	uintptr_t ret = 0;
+
+	{
+		lock::ScopedLock guard(cache.lock);
+
+		if(cache.count != 0)
+		{
+			ret = cache.frames[cache.count - 1];
+
+			__atomic_store_n(&cache.count, cache.count - 1, __ATOMIC_RELAXED);
+			__atomic_store_n(&cache.hits, cache.hits + 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	if(ret == 0)
+	{
+		uintptr_t frames[FRAME_CACHE_BATCH];
+		size_t found = 0;
+
+		{
+			lock::ScopedLock guard(phys_lock);
+
+			const size_t node = local_node();
+
+			while(found < FRAME_CACHE_BATCH)
+			{
+				const size_t page = search_node(node, 0, [](PhysicalRange& range) {
+					return find_pages(range, 1);
+				});
+
+				if(page == SummaryBitmap::npos)
+				{
+					break;
+				}
+
+				mark_used(page, 1);
+				frames[found++] = page * PAGE_SIZE;
+			}
+		}
+
+		lock::ScopedLock guard(cache.lock);
+
+		// The cache is still empty, nobody but its owner fills it.
+		for(size_t i = 1; i < found; i++)
+		{
+			cache.frames[i - 1] = frames[i];
+		}
+
+		ret = (found != 0) ? frames[0] : 0;
+
+		__atomic_store_n(&cache.count, (found != 0) ? (found - 1) : 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&cache.misses, cache.misses + 1, __ATOMIC_RELAXED);
+	}
+
+	if(interrupts)
+	{
+		enable_interrupts();
+	}
+
+	return ret;
+}
+
+// Returns a frame to the local CPU cache, draining half of it in one batch when it is full.
+static void cache_free(uintptr_t frame)
+{
+	const bool interrupts = arch::interrupt_status();
+	disable_interrupts();
+
+	FrameCache& cache = cpu::smp::get_cpu_data()->frame_cache;
+	uintptr_t drained[FRAME_CACHE_BATCH];
+	size_t drained_count = 0;
+
+	{
+		lock::ScopedLock guard(cache.lock);
+
+		size_t count = cache.count;
+
+		if(count == FRAME_CACHE_SIZE)
+		{
+			while(drained_count < FRAME_CACHE_BATCH)
+			{
+				drained[drained_count++] = cache.frames[--count];
+			}
+		}
+
+		cache.frames[count++] = frame;
+		__atomic_store_n(&cache.count, count, __ATOMIC_RELAXED);
+	}
+
+	if(drained_count != 0)
+	{
+		lock::ScopedLock guard(phys_lock);
+
+		for(size_t i = 0; i < drained_count; i++)
+		{
+			free_pages(drained[i] / PAGE_SIZE, 1);
+		}
+	}
+
+	if(interrupts)
+	{
+		enable_interrupts();
+	}
+}
+
+// Hands `count` frames at `ptr` over to a new owner.
+static void* claim_frames(void* ptr, size_t count, size_t order)
+{
+	PageFrame* frames = &phys_frames[reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE];
+
+	for(size_t i = 0; i < count; i++)
+	{
+		frames[i] = {1, static_cast<uint8_t>(order), 0, 0, 0};
+	}
+
+	return ptr;
+}
+
+static void release_frames(void* ptr, size_t count)
+{
+	PageFrame* frames = &phys_frames[reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE];
+	memset(frames, 0, count * sizeof(PageFrame));
+}
+
+// Takes an already zeroed frame of `node`, or returns 0 if its pool is empty.
+static uintptr_t zero_pool_allocate(size_t node)
+{
+	ZeroPool& pool = phys_nodes[node].zero_pool;
+
+	// Don't bother every allocating CPU with the lock while the pool is drained.
+	if(__atomic_load_n(&pool.count, __ATOMIC_RELAXED) == 0)
+	{
+		__atomic_fetch_add(&zero_pool_misses, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	lock::ScopedLock guard(zero_pool_lock);
+
+	const size_t count = pool.count;
+
+	if(count == 0)
+	{
+		__atomic_fetch_add(&zero_pool_misses, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	__atomic_fetch_add(&zero_pool_hits, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&pool.count, count - 1, __ATOMIC_RELAXED);
+
+	return pool.frames[count - 1];
+}
+
+static void* allocate_frames(size_t count, uint32_t flags)
+{
+	void* ret = nullptr;
+	const size_t node = preferred_node(flags);
+
+	// Zero pools and CPU caches only hold frames of one node, and don't care about zones.
+	const bool pooled = (count == 1) && !(flags & PHYS_ALLOC_DMA32);
+	const bool cached = pooled && cpu::smp::cpu_data_initialized() && (node == local_node());
+
+	if(pooled && !(flags & PHYS_ALLOC_NO_ZERO))
+	{
+		ret = reinterpret_cast<void*>(zero_pool_allocate(node));
+
+		if(ret != nullptr)
+		{
+			return claim_frames(ret, 1, 0);
+		}
+	}
+
+	if(cached)
+	{
+		ret = reinterpret_cast<void*>(cache_allocate());
+	}
+
+	if(ret == nullptr)
+	{
+		lock::ScopedLock guard(phys_lock);
+		ret = reinterpret_cast<void*>(allocate_pages(count, node, flags) * PAGE_SIZE);
+	}
+
+	if(!(flags & PHYS_ALLOC_NO_ZERO))
+	{
+		memset(to_higher_half(ret), 0, count * PAGE_SIZE);
+	}
+
+	return claim_frames(ret, count, 0);
+}
+
+static void free_frames(void* ptr, size_t count)
+{
+	release_frames(ptr, count);
+
+	const size_t page = reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE;
+
+	// Frames of remote nodes go straight back to the bitmap instead of the local cache.
+	if((count == 1) && cpu::smp::cpu_data_initialized() && (node_of(page) == local_node()))
+	{
+		return cache_free(reinterpret_cast<uintptr_t>(ptr));
+	}
+
+	lock::ScopedLock guard(phys_lock);
+	free_pages(page, count);
+}
+
+void* physical_allocate(size_t count, uint32_t flags)
+{
+	if(count == 0)
+	{
+		return nullptr;
+	}
+
+	const uint64_t start_time = cpu::read_tsc();
+	void* ret = allocate_frames(count, flags);
+
+	record_latency(true, start_time);
+
+	return ret;
+}
+
+void physical_free(void* ptr, size_t count)
+{
+	if(ptr == nullptr)
+	{
+		return;
+	}
+
+	const uint64_t start_time = cpu::read_tsc();
+	free_frames(ptr, count);
+
+	record_latency(false, start_time);
+}
+
+void physical_allocate_bulk(void** frames, size_t count, uint32_t flags)
+{
+	if(count == 0)
+	{
+		return;
+	}
+
+	const uint64_t start_time = cpu::read_tsc();
+
+	{
+		lock::ScopedLock guard(phys_lock);
+		allocate_pages_bulk(frames, count, preferred_node(flags), flags);
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if(!(flags & PHYS_ALLOC_NO_ZERO))
+		{
+			memset(to_higher_half(frames[i]), 0, PAGE_SIZE);
+		}
+
+		claim_frames(frames[i], 1, 0);
+	}
+
+	record_latency(true, start_time);
+}
+
+void physical_free_bulk(void** frames, size_t count)
+{
+	if(count == 0)
+	{
+		return;
+	}
+
+	const uint64_t start_time = cpu::read_tsc();
+
+	for(size_t i = 0; i < count; i++)
+	{
+		release_frames(frames[i], 1);
+	}
+
+	{
+		lock::ScopedLock guard(phys_lock);
+
+		for(size_t i = 0; i < count; i++)
+		{
+			free_pages(reinterpret_cast<uintptr_t>(frames[i]) / PAGE_SIZE, 1);
+		}
+	}
+
+	record_latency(false, start_time);
+}
+
+void* physical_allocate_order(size_t order, size_t align, uint32_t flags)
+{
+	const size_t count = 1ull << order;
+	size_t page = SummaryBitmap::npos;
+
+	// Blocks are naturally aligned; `align` can only raise the alignment further.
+	align = std::max(align / PAGE_SIZE, count);
+
+	if((align & (align - 1)) != 0)
+	{
+		log_error("Invalid alignment for an order %lu block: 0x%lx", order, align * PAGE_SIZE);
+		return nullptr;
+	}
+
+	{
+		lock::ScopedLock guard(phys_lock);
+		page = allocate_aligned_pages(count, align, preferred_node(flags), flags);
+	}
+
+	// Large blocks are opportunistic, callers fall back to smaller pages.
+	if(page == SummaryBitmap::npos)
+	{
+		return nullptr;
+	}
+
+	void* ret = reinterpret_cast<void*>(page * PAGE_SIZE);
+
+	if(!(flags & PHYS_ALLOC_NO_ZERO))
+	{
+		memset(to_higher_half(ret), 0, count * PAGE_SIZE);
+	}
+
+	return claim_frames(ret, count, order);
+}
+
+void physical_free_order(void* ptr, size_t order)
+{
+	if(ptr == nullptr)
+	{
+		return;
+	}
+
+	release_frames(ptr, 1ull << order);
+
+	lock::ScopedLock guard(phys_lock);
+	free_pages(reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE, 1ull << order);
+}
+
+PageFrame* physical_get_frame(void* ptr)
+{
+	const size_t page = reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE;
+	return (page < phys_bitmap.size()) ? &phys_frames[page] : nullptr;
+}
+
+void physical_frame_get(void* ptr)
+{
+	PageFrame* frame = physical_get_frame(ptr);
+	assert((frame != nullptr) && (frame->refcount != 0));
+
+	__atomic_fetch_add(&frame->refcount, 1, __ATOMIC_RELAXED);
+}
+
+bool physical_frame_put(void* ptr)
+{
+	PageFrame* frame = physical_get_frame(ptr);
+	assert((frame != nullptr) && (frame->refcount != 0));
+
+	if(__atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+	{
+		return false;
+	}
+
+	// Frames of an order block are only ever released together, through the first one.
+	if(frame->order != 0)
+	{
+		physical_free_order(ptr, frame->order);
+	}
+	else
+	{
+		physical_free(ptr);
+	}
+
+	return true;
+}
+
+bool physical_refill_zero_pool()
+{
+	const size_t node = local_node();
+	ZeroPool& pool = phys_nodes[node].zero_pool;
+
+	if(__atomic_load_n(&pool.count, __ATOMIC_RELAXED) >= ZERO_POOL_SIZE)
+	{
+		return false;
+	}
+
+	size_t page = SummaryBitmap::npos;
+
+	// Refills go around the telemetry and the frame cache, they aren't on anybody's allocation
+	// path. Zeroing ahead must not be what runs the node dry, so it stops at a low-water mark.
+	{
+		lock::ScopedLock guard(phys_lock);
+
+		if(phys_nodes[node].free_pages > ZERO_POOL_LOW_WATER)
+		{
+			page = search_node(node, 0, [](PhysicalRange& range) { return find_pages(range, 1); });
+		}
+
+		if(page == SummaryBitmap::npos)
+		{
+			return false;
+		}
+
+		mark_used(page, 1);
+	}
+
+	const uintptr_t frame = page * PAGE_SIZE;
+
+	// Zeroed frames are handed out later, keep them out of this CPU's cache.
+	cpu::zero_nontemporal(to_higher_half(reinterpret_cast<void*>(frame)), PAGE_SIZE);
+
+	{
+		lock::ScopedLock guard(zero_pool_lock);
+
+		const size_t count = pool.count;
+
+		if(count < ZERO_POOL_SIZE)
+		{
+			pool.frames[count] = frame;
+			__atomic_store_n(&pool.count, count + 1, __ATOMIC_RELAXED);
+
+			return true;
+		}
+	}
+
+	// Another CPU filled the pool in the meantime.
+	lock::ScopedLock guard(phys_lock);
+	free_pages(page, 1);
+
+	return false;
+}
+
+// Nodes are created in the order their proximity domains first show up in the SRAT.
+static size_t node_for_domain(uint32_t domain)
+{
+	for(size_t i = 0; i < phys_node_count; i++)
+	{
+		if(phys_nodes[i].proximity_domain == domain)
+		{
+			return i;
+		}
+	}
+
+	if(phys_node_count == PHYS_MAX_NODES)
+	{
+		log_warning("Too many NUMA nodes, proximity domain %u is folded into node 0", domain);
+		return 0;
+	}
+
+	phys_nodes[phys_node_count].proximity_domain = domain;
+	return phys_node_count++;
+}
+
+static uint32_t get_proximity_domain(const acpi_srat_processor_affinity& affinity)
+{
+	return affinity.proximity_domain_low | (affinity.proximity_domain_high[0] << 8) |
+		   (affinity.proximity_domain_high[1] << 16) | (affinity.proximity_domain_high[2] << 24);
+}
+
+void physical_initialize_nodes()
+{
+	std::vector<acpi_srat_memory_affinity> memory_affinities;
+	std::vector<acpi_srat_processor_affinity> processor_affinities;
+	std::vector<acpi_srat_x2apic_affinity> x2apic_affinities;
+
+	drivers::acpi::get_memory_affinities(memory_affinities);
+	drivers::acpi::get_processor_affinities(processor_affinities);
+	drivers::acpi::get_x2apic_affinities(x2apic_affinities);
+
+	if(memory_affinities.empty())
+	{
+		return;
+	}
+
+	lock::ScopedLock guard(phys_lock);
+
+	// Zeroed frames are kept per node, hand them back before the nodes change.
+	drain_zero_pools();
+
+	memset(phys_nodes, 0, sizeof(phys_nodes));
+	phys_node_count = 0;
+	phys_range_count = 0;
+
+	for(const acpi_srat_memory_affinity& affinity : memory_affinities)
+	{
+		if(!(affinity.flags & SRAT_MEMORY_ENABLED))
+		{
+			continue;
+		}
+
+		add_range(node_for_domain(affinity.proximity_domain), affinity.address / PAGE_SIZE,
+				  (affinity.address + affinity.length) / PAGE_SIZE);
+	}
+
+	// Processors may live in domains without any memory of their own.
+	for(const acpi_srat_processor_affinity& affinity : processor_affinities)
+	{
+		if(affinity.flags & SRAT_PROCESSOR_ENABLED)
+		{
+			node_for_domain(get_proximity_domain(affinity));
+		}
+	}
+
+	for(const acpi_srat_x2apic_affinity& affinity : x2apic_affinities)
+	{
+		if(affinity.flags & SRAT_PROCESSOR_ENABLED)
+		{
+			node_for_domain(affinity.proximity_domain);
+		}
+	}
+
+	if(phys_node_count == 0)
+	{
+		phys_node_count = 1;
+	}
+
+	// Memory the SRAT doesn't describe still has to be allocatable, it goes to node 0.
+	std::sort(phys_ranges, phys_ranges + phys_range_count,
+			  [](const PhysicalRange& a, const PhysicalRange& b) {
+				  return a.start < b.start;
+			  });
+
+	const size_t described_ranges = phys_range_count;
+	size_t next = 0;
+
+	for(size_t i = 0; i < described_ranges; i++)
+	{
+		add_range(0, next, phys_ranges[i].start);
+		next = std::max(next, phys_ranges[i].end);
+	}
+
+	add_range(0, next, phys_bitmap.size());
+
+	for(size_t i = 0; i < phys_range_count; i++)
+	{
+		const PhysicalRange& range = phys_ranges[i];
+		phys_nodes[range.node].free_pages += phys_bitmap.count_clear(range.start, range.end);
+	}
+
+	for(size_t i = 0; i < phys_node_count; i++)
+	{
+		PhysicalNode& node = phys_nodes[i];
+
+		for(size_t j = 0; j < phys_node_count; j++)
+		{
+			node.fallback[j] = j;
+		}
+
+		// The distance to itself is the smallest, so the node ends up first. Equal distances
+		// keep the node order. std::stable_sort would allocate, which needs phys_lock.
+		std::sort(node.fallback, node.fallback + phys_node_count, [&](size_t a, size_t b) {
+			const uint32_t from = node.proximity_domain;
+			const uint8_t distance_a =
+				drivers::acpi::get_locality_distance(from, phys_nodes[a].proximity_domain);
+			const uint8_t distance_b =
+				drivers::acpi::get_locality_distance(from, phys_nodes[b].proximity_domain);
+
+			return (distance_a != distance_b) ? (distance_a < distance_b) : (a < b);
+		});
+
+		log_debug("NUMA node %lu: proximity domain %u, %lu pages spanned, %lu pages free", i,
+				  node.proximity_domain, node.spanned_pages, node.free_pages);
+	}
+
+	for(size_t i = 0; i < cpu::smp::get_cpu_count(); i++)
+	{
+		cpu::smp::PlatformCpuData* cpu_data = cpu::smp::get_cpu_data(i);
+		cpu_data->numa_node = 0;
+
+		for(const acpi_srat_processor_affinity& affinity : processor_affinities)
+		{
+			if((affinity.flags & SRAT_PROCESSOR_ENABLED) &&
+			   (affinity.id == static_cast<uint32_t>(cpu_data->local_apic_id)))
+			{
+				cpu_data->numa_node = node_for_domain(get_proximity_domain(affinity));
+			}
+		}
+
+		for(const acpi_srat_x2apic_affinity& affinity : x2apic_affinities)
+		{
+			if((affinity.flags & SRAT_PROCESSOR_ENABLED) &&
+			   (affinity.id == static_cast<uint32_t>(cpu_data->local_apic_id)))
+			{
+				cpu_data->numa_node = node_for_domain(affinity.proximity_domain);
+			}
+		}
+	}
+}
+
+struct ReclaimRange
+{
+	size_t start;
+	size_t end;
+};
+
+// Must be called with `phys_lock` held. Frees [start, end) except for the holes, which are
+// still in use, and returns the number of pages freed.
+static size_t reclaim_range(size_t start, size_t end, const std::vector<ReclaimRange>& holes,
+							size_t hole)
+{
+	for(; hole < holes.size(); hole++)
+	{
+		if((holes[hole].start < end) && (holes[hole].end > start))
+		{
+			return reclaim_range(start, holes[hole].start, holes, hole + 1) +
+				   reclaim_range(holes[hole].end, end, holes, hole + 1);
+		}
+	}
+
+	end = std::min(end, phys_bitmap.size());
+
+	if(start >= end)
+	{
+		return 0;
+	}
+
+	phys_bitmap.clear_range(start, end);
+
+	for(size_t i = 0; i < phys_range_count; i++)
+	{
+		const PhysicalRange& range = phys_ranges[i];
+		const size_t overlap_start = std::max(start, range.start);
+		const size_t overlap_end = std::min(end, range.end);
+
+		if(overlap_start < overlap_end)
+		{
+			phys_nodes[range.node].free_pages += (overlap_end - overlap_start);
+		}
+	}
+
+	return end - start;
+}
+
+void physical_reclaim_bootloader_memory()
+{
+	const size_t memmap_count = memmap_request.response->entry_count;
+	limine_memmap_entry** memmaps = memmap_request.response->entries;
+	const uint64_t start_time = cpu::read_tsc();
+
+	std::vector<ReclaimRange> ranges;
+	std::vector<ReclaimRange> stacks;
+
+	// The memory map lives in reclaimable memory itself, so copy it before freeing anything.
+	for(size_t i = 0; i < memmap_count; i++)
+	{
+		if(memmaps[i]->type == LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE)
+		{
+			ranges.push_back({memmaps[i]->base / PAGE_SIZE,
+							  (memmaps[i]->base + memmaps[i]->length) / PAGE_SIZE});
+		}
+	}
+
+	// The CPUs still run on the stacks the bootloader gave them. Only a pointer somewhere into
+	// each stack is known, so keep a whole stack size on either side of it.
+	for(size_t i = 0; i < cpu::smp::get_cpu_count(); i++)
+	{
+		const uintptr_t stack = cpu::smp::get_cpu_data(i)->boot_stack;
+
+		if(stack == 0)
+		{
+			continue;
+		}
+
+		const uintptr_t address = from_higher_half(stack);
+		const uintptr_t stack_size = stack_size_request.stack_size;
+
+		stacks.push_back({(address - std::min(address, stack_size)) / PAGE_SIZE,
+						  align_up(address + stack_size, PAGE_SIZE) / PAGE_SIZE});
+	}
+
+	size_t reclaimed = 0;
+
+	{
+		lock::ScopedLock guard(phys_lock);
+
+		for(const ReclaimRange& range : ranges)
+		{
+			reclaimed += reclaim_range(range.start, range.end, stacks, 0);
+		}
+
+		phys_stats.usable_pages += reclaimed;
+		phys_stats.free_pages += reclaimed;
+	}
+
+	log_info("Reclaimed %lu MiB of bootloader memory in %lu TSC cycles",
+			 (reclaimed * PAGE_SIZE) / (1024 * 1024), cpu::read_tsc() - start_time);
+}
+
+// Frees `percent` percent of the bitmap at random, always the same bits for the same seed.
+static void fill_benchmark_bitmap(SummaryBitmap& bitmap, uint64_t* buffer, size_t percent)
+{
+	uint64_t seed = 0x9e3779b97f4a7c15;
+
+	bitmap.initialize(buffer, PHYS_BENCHMARK_FRAMES);
+
+	for(size_t i = 0; i < PHYS_BENCHMARK_FRAMES; i++)
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		if((seed % 100) >= percent)
+		{
+			bitmap.clear(i);
+		}
+	}
+}
+
+// The scanner physical_allocate used before the summaries, testing one bit after the other.
+static size_t linear_find_clear(const SummaryBitmap& bitmap, size_t& cursor)
+{
+	for(size_t i = 0; i < PHYS_BENCHMARK_FRAMES; i++)
+	{
+		const size_t page = cursor;
+		cursor = (cursor + 1) % PHYS_BENCHMARK_FRAMES;
+
+		if(!bitmap.test(page))
+		{
+			return page;
+		}
+	}
+
+	return SummaryBitmap::npos;
+}
+
+void physical_benchmark_allocate()
+{
+	static constexpr size_t fill_levels[] = {50, 90, 99};
+
+	const size_t pages = div_roundup(SummaryBitmap::storage_size(PHYS_BENCHMARK_FRAMES), PAGE_SIZE);
+	void* frames = physical_allocate(pages, PHYS_ALLOC_NO_ZERO);
+	uint64_t* buffer = static_cast<uint64_t*>(to_higher_half(frames));
+	SummaryBitmap bitmap;
+
+	for(const size_t percent : fill_levels)
+	{
+		uint64_t cycles[2] = {};
+
+		// Both scanners continue after their previous result, like the ranges do.
+		for(size_t linear = 0; linear < 2; linear++)
+		{
+			size_t cursor = 0;
+
+			fill_benchmark_bitmap(bitmap, buffer, percent);
+
+			const uint64_t start_time = cpu::read_tsc();
+
+			for(size_t i = 0; i < PHYS_BENCHMARK_ROUNDS; i++)
+			{
+				size_t page = linear ? linear_find_clear(bitmap, cursor)
+									 : bitmap.find_clear(cursor, PHYS_BENCHMARK_FRAMES);
+
+				if(!linear && (page == SummaryBitmap::npos))
+				{
+					page = bitmap.find_clear(0, cursor);
+				}
+
+				bitmap.set(page);
+				cursor = (page + 1) % PHYS_BENCHMARK_FRAMES;
+			}
+
+			cycles[linear] = (cpu::read_tsc() - start_time) / PHYS_BENCHMARK_ROUNDS;
+		}
+
+		log_info("Frame allocation with %lu%% of %lu frames used: %lu cycles with the summaries, "
+				 "%lu with the linear scan",
+				 percent, PHYS_BENCHMARK_FRAMES, cycles[0], cycles[1]);
+	}
+
+	physical_free(frames, pages);
 }
 } // namespace memory
\ No newline at end of file
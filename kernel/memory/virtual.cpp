@@ -2,15 +2,117 @@
 #include <logger.h>
 #include <assert.h>
 
+#include <algorithm>
+
 #include <memory/physical.hpp>
 #include <memory/memory.hpp>
 #include <memory/paging.hpp>
 #include <memory/virtual.hpp>
+#include <memory/virtual_range.hpp>
+
+#include <cpu/cpu.hpp>
+
+// Number of frames virtual_allocate takes from the PMM at once.
+#define VIRTUAL_ALLOCATE_BATCH 128ul
+
+// Physical segments count_mapped asks for per translation.
+#define VIRTUAL_TRANSLATE_SEGMENTS 16ul
+
+// Unmapped pages left after every allocation, so overruns fault instead of corrupting a
+// neighbour.
+#define VIRTUAL_GUARD_PAGES 1ul
+
+// Ranges of RAM virtual_direct_map knows about. Entries past it are treated as not being RAM.
+#define VIRTUAL_DIRECT_RANGES 64
+
+// Bounds of the kernel image sections, provided by the linker script.
+extern "C" char __kernel_text_start[], __kernel_text_end[];
+extern "C" char __kernel_rodata_start[], __kernel_rodata_end[];
+extern "C" char __kernel_data_start[], __kernel_data_end[];
 
 namespace memory
 {
 PageMap base_pagemap = PageMap();
 
+// Address space between the direct map and the kernel image.
+static VirtualRangeAllocator kernel_ranges;
+static uintptr_t kernel_ranges_base = 0;
+
+// Regions from virtual_reserve, kept as the free ranges of an allocator of their own so a
+// fault finds its region in the same tree. The lock serializes faults on the same page.
+static VirtualRangeAllocator demand_ranges;
+static lock::mutex demand_lock;
+static uintptr_t zero_page = 0;
+
+// RAM the direct map covers write-back. The memory map is reclaimed later on, so the ranges
+// are copied out of it, merging adjacent entries.
+struct DirectRange
+{
+	uintptr_t start;
+	uintptr_t end;
+};
+
+static DirectRange direct_ranges[VIRTUAL_DIRECT_RANGES];
+static size_t direct_range_count = 0;
+
+static bool is_ram(uint64_t type)
+{
+	switch(type)
+	{
+		case LIMINE_MEMMAP_USABLE:
+		case LIMINE_MEMMAP_ACPI_RECLAIMABLE:
+		case LIMINE_MEMMAP_ACPI_NVS:
+		case LIMINE_MEMMAP_BOOTLOADER_RECLAIMABLE:
+		case LIMINE_MEMMAP_KERNEL_AND_MODULES:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void add_direct_range(uintptr_t start, uintptr_t end)
+{
+	if((direct_range_count > 0) && (direct_ranges[direct_range_count - 1].end == start))
+	{
+		direct_ranges[direct_range_count - 1].end = end;
+	}
+	else if(direct_range_count < VIRTUAL_DIRECT_RANGES)
+	{
+		direct_ranges[direct_range_count++] = {start, end};
+	}
+}
+
+// Kernel mappings are shared by every address space, so they are global and survive switches.
+// Not an assert, the mapping must not be compiled out of release builds.
+static void map_contiguous(uintptr_t virtual_address, uintptr_t physical_address, size_t size,
+						   size_t flags)
+{
+	if(base_pagemap.map_range(virtual_address, physical_address, size, flags | MAP_GLOBAL) !=
+	   SYSTEM_OK)
+	{
+		log_panik("Could not map 0x%.16lx", virtual_address);
+	}
+}
+
+static void map_direct_run(uintptr_t start, uintptr_t end)
+{
+	if(end > start)
+	{
+		map_contiguous(to_higher_half(start), start, end - start,
+					   MAP_READ | MAP_WRITE | MAP_WRITE_BACK);
+	}
+}
+
+static void map_kernel_section(const char* start, const char* end, size_t flags)
+{
+	const uintptr_t virtual_base = align_down(reinterpret_cast<uintptr_t>(start), PAGE_SIZE);
+	const uintptr_t virtual_top = align_up(reinterpret_cast<uintptr_t>(end), PAGE_SIZE);
+	const uintptr_t physical_base =
+		boot_info.kernel_physical_base + (virtual_base - boot_info.kernel_virtual_base);
+
+	map_contiguous(virtual_base, physical_base, virtual_top - virtual_base, flags);
+}
+
 void virtual_initialize()
 {
 	const size_t memmap_count = memmap_request.response->entry_count;
@@ -18,66 +120,75 @@ void virtual_initialize()
 
 	log_begin_intialization("Virtual Memory Manager");
 
+	const uint64_t start_time = cpu::read_tsc();
+	PhysicalMemoryStats stats = {};
+	physical_get_status(&stats);
+	const size_t used_pages = stats.used_pages;
+
 	base_pagemap.initialize(true);
 
-	// Virtual memory allocate doesn't work when mapping with size > 0x1000.
-	// So, Map everything with page size 0x1000.
-	for(uintptr_t i = 0; i < (PAGE_SIZE_1GiB * 4); i += PAGE_SIZE)
-	{
-		assert(!base_pagemap.map_page(to_higher_half(i), i, MAP_READ | MAP_WRITE | MAP_WRITE_BACK));
-	}
+	// Only RAM goes into the direct map. A large page spanning RAM and a device hole would have
+	// an undefined memory type, and would alias the uncached mappings of io_map. Adjacent RAM
+	// entries are mapped as one run, so their boundary doesn't break up large pages.
+	uintptr_t run_start = 0;
+	uintptr_t run_end = 0;
 
-	// Map if any memory map entry is above 4 GiB.
 	for(size_t i = 0; i < memmap_count; i++)
 	{
 		limine_memmap_entry* entry = memmaps[i];
+		const uintptr_t base = align_down(entry->base, PAGE_SIZE);
+		const uintptr_t top = align_up(entry->base + entry->length, PAGE_SIZE);
 
-		uintptr_t base = align_down(entry->base, PAGE_SIZE);
-		uintptr_t top = align_up(entry->base + entry->length, PAGE_SIZE);
-
-		if(top < (PAGE_SIZE_1GiB * 4))
+		if(entry->type == LIMINE_MEMMAP_FRAMEBUFFER)
 		{
-			continue;
+			map_contiguous(to_higher_half(base), base, top - base,
+						   MAP_READ | MAP_WRITE | MAP_WRITE_COMBINING);
 		}
 
-		size_t cache = MAP_WRITE_BACK;
-
-		if(entry->type == LIMINE_MEMMAP_FRAMEBUFFER)
+		if(!is_ram(entry->type))
 		{
-			cache = MAP_WRITE_COMBINING;
+			continue;
 		}
 
-		size_t size = top - base;
+		add_direct_range(entry->base, entry->base + entry->length);
 
-		for(uintptr_t j = base; j < (base + size); j += PAGE_SIZE)
+		if(base > run_end)
 		{
-			if(j < (PAGE_SIZE_1GiB * 4))
-			{
-				continue;
-			}
-
-			assert(!base_pagemap.map_page(to_higher_half(j), j, MAP_READ | MAP_WRITE | cache));
+			map_direct_run(run_start, run_end);
+			run_start = base;
 		}
+
+		run_end = std::max(run_end, top);
 	}
 
-	const limine_file* kernel_file = kernel_file_request.response->kernel_file;
-	const uintptr_t virtual_base = kernel_address_request.response->virtual_base;
-	const uintptr_t physical_base = kernel_address_request.response->physical_base;
+	map_direct_run(run_start, run_end);
 
-	// Map the kernel
-	for(size_t i = 0; i < kernel_file->size; i += PAGE_SIZE)
-	{
-		assert(!base_pagemap.map_page(virtual_base + i, physical_base + i,
-									  MAP_WRITE | MAP_READ | MAP_EXEC | MAP_WRITE_BACK));
-	}
+	// Map the kernel, each section with the permissions of its segment.
+	map_kernel_section(__kernel_text_start, __kernel_text_end,
+					   MAP_READ | MAP_EXEC | MAP_WRITE_BACK);
+	map_kernel_section(__kernel_rodata_start, __kernel_rodata_end, MAP_READ | MAP_WRITE_BACK);
+	map_kernel_section(__kernel_data_start, __kernel_data_end,
+					   MAP_READ | MAP_WRITE | MAP_WRITE_BACK);
 
 	base_pagemap.load();
 
+	const uintptr_t direct_map_top =
+		std::max(align_up(stats.highest_physical_addr, PAGE_SIZE_1GiB), PAGE_SIZE_1GiB * 4);
+
+	kernel_ranges_base = to_higher_half(direct_map_top);
+	kernel_ranges.initialize(kernel_ranges_base, boot_info.kernel_virtual_base);
+
+	zero_page = physical_allocate<uintptr_t>();
+
+	physical_get_status(&stats);
+
 	log_end_intialization();
 
-	log_debug("Kernel Virtual Base = 0x%.16lx", virtual_base);
-	log_debug("Kernel Physical Base = 0x%.16lx", physical_base);
-	log_debug("Kernel Size = %lu", kernel_file->size);
+	log_debug("Kernel Virtual Base = 0x%.16lx", boot_info.kernel_virtual_base);
+	log_debug("Kernel Physical Base = 0x%.16lx", boot_info.kernel_physical_base);
+	log_debug("Kernel Size = %lu", kernel_file_request.response->kernel_file->size);
+	log_debug("Page tables = %lu pages, mapped in %lu TSC cycles", stats.used_pages - used_pages,
+			  cpu::read_tsc() - start_time);
 }
 
 PageMap* get_current_pagemap()
@@ -127,143 +238,362 @@ std::pair<size_t, size_t> required_page_size(size_t size)
 	return std::make_pair(PAGE_SIZE, 0);
 }
 
-void* virtual_allocate(uintptr_t base, uintptr_t limit, size_t count, size_t flags)
+// Returns how many pages from address onwards are mapped, up to count.
+static size_t count_mapped(PageMap* pagemap, uintptr_t address, size_t count)
 {
-	const size_t size = count * PAGE_SIZE;
-	uintptr_t start = base;
-	uintptr_t end = limit - (count * PAGE_SIZE);
-	uintptr_t address = 0;
-	PageMap* pagemap = get_current_pagemap();
+	PhysicalSegment segments[VIRTUAL_TRANSLATE_SEGMENTS];
+	size_t mapped = 0;
+
+	while(mapped < count)
+	{
+		const size_t found = pagemap->translate(address + (mapped * PAGE_SIZE),
+												(count - mapped) * PAGE_SIZE, segments,
+												VIRTUAL_TRANSLATE_SEGMENTS);
+
+		for(size_t i = 0; i < found; i++)
+		{
+			mapped += segments[i].size / PAGE_SIZE;
+		}
 
-	do
+		// Fewer segments than asked for means the walk hit an unmapped page or the end.
+		if(found < VIRTUAL_TRANSLATE_SEGMENTS)
+		{
+			break;
+		}
+	}
+
+	return mapped;
+}
+
+// Unmaps up to count pages, stopping at the first one not mapped, and frees their frames.
+static void unmap_frames(PageMap* pagemap, uintptr_t address, size_t count)
+{
+	void* frames[VIRTUAL_ALLOCATE_BATCH];
+
+	while(count > 0)
 	{
-		for(address = start; address < (start + size); address += PAGE_SIZE)
+		const size_t limit = std::min(count, VIRTUAL_ALLOCATE_BATCH);
+		size_t batch = 0;
+
+		for(; batch < limit; batch++)
 		{
-			if(pagemap->virtual_to_entry(address, false, PAGE_SIZE, true)->is_valid())
+			const uintptr_t virtual_address = address + (batch * PAGE_SIZE);
+			const uintptr_t physical_address = pagemap->virtual_to_physical(virtual_address);
+
+			if(physical_address == static_cast<uintptr_t>(-1))
 			{
-				// Found a valid page
 				break;
 			}
+
+			frames[batch] = reinterpret_cast<void*>(physical_address);
 		}
 
-		if(address >= (start + size))
+		// The frames are only handed back once the TLB can no longer reach them.
+		pagemap->unmap_range(address, batch * PAGE_SIZE);
+		physical_free_bulk(frames, batch);
+
+		if(batch < limit)
+		{
+			break;
+		}
+
+		address += batch * PAGE_SIZE;
+		count -= batch;
+	}
+}
+
+// Maps `count` fresh frames at `address`. Frames are taken in batches, each under a single
+// acquisition of the PMM lock. On failure, nothing stays mapped.
+static bool map_frames(PageMap* pagemap, uintptr_t address, size_t count, size_t flags)
+{
+	void* frames[VIRTUAL_ALLOCATE_BATCH];
+
+	for(size_t i = 0; i < count; i += VIRTUAL_ALLOCATE_BATCH)
+	{
+		const size_t batch = std::min(count - i, VIRTUAL_ALLOCATE_BATCH);
+		physical_allocate_bulk(frames, batch);
+
+		// Physically contiguous frames are mapped as one range.
+		for(size_t j = 0, run = 1; j < batch; j += run, run = 1)
 		{
-			for(size_t i = 0; i < size; i += PAGE_SIZE)
+			const uintptr_t physical_address = reinterpret_cast<uintptr_t>(frames[j]);
+
+			while(((j + run) < batch) && (reinterpret_cast<uintptr_t>(frames[j + run]) ==
+										  (physical_address + (run * PAGE_SIZE))))
 			{
-				void* physical_address = physical_allocate();
-				if(pagemap->map_page(start + i, reinterpret_cast<uintptr_t>(physical_address) + i,
-									 flags))
-				{
-					goto failure;
-				}
+				run++;
 			}
 
-			pagemap->load();
-			return reinterpret_cast<void*>(start);
+			if(pagemap->map_range(address + ((i + j) * PAGE_SIZE), physical_address,
+								  run * PAGE_SIZE, flags | MAP_GLOBAL))
+			{
+				physical_free_bulk(frames + j, batch - j);
+				unmap_frames(pagemap, address, i + j);
+
+				return false;
+			}
 		}
+	}
 
-		start += PAGE_SIZE;
-	} while(start < end);
+	return true;
+}
 
-failure:
-	pagemap->load();
-	return nullptr;
+// Unmaps a range from virtual_allocate_large. Chunks backed by a 2 MiB block go back to the PMM
+// as one block, the others frame by frame.
+static void unmap_chunks(PageMap* pagemap, uintptr_t address, size_t count)
+{
+	const size_t chunk = PAGE_SIZE_2MiB / PAGE_SIZE;
+
+	for(size_t i = 0; i < count; i += chunk)
+	{
+		const uintptr_t virtual_address = address + (i * PAGE_SIZE);
+		const uintptr_t physical_address = pagemap->virtual_to_physical(virtual_address);
+		PageFrame* frame = physical_get_frame(reinterpret_cast<void*>(physical_address));
+
+		if((physical_address != static_cast<uintptr_t>(-1)) && (frame != nullptr) &&
+		   (frame->order == PHYS_ORDER_2MB))
+		{
+			pagemap->unmap_range(virtual_address, PAGE_SIZE_2MiB);
+			physical_free_order(reinterpret_cast<void*>(physical_address), PHYS_ORDER_2MB);
+		}
+		else
+		{
+			unmap_frames(pagemap, virtual_address, std::min(count - i, chunk));
+		}
+	}
 }
 
-void* virtual_allocate(size_t count, size_t flags)
+void* virtual_allocate(uintptr_t base, uintptr_t limit, size_t count, size_t flags)
 {
-	PhysicalMemoryStats stats = {};
-	physical_get_status(&stats);
+	const size_t reserved = (count + VIRTUAL_GUARD_PAGES) * PAGE_SIZE;
+	const uintptr_t start = kernel_ranges.allocate(reserved, PAGE_SIZE, base, limit);
+
+	if(start == 0)
+	{
+		return nullptr;
+	}
+
+	if(!map_frames(get_current_pagemap(), start, count, flags))
+	{
+		kernel_ranges.free(start, reserved);
+		return nullptr;
+	}
 
-	const uintptr_t virtual_base = to_higher_half(stats.highest_physical_addr);
-	const uintptr_t kernel_virtual_base = kernel_address_request.response->virtual_base;
-	return virtual_allocate(virtual_base, kernel_virtual_base, count, flags);
+	return reinterpret_cast<void*>(start);
 }
 
-void* virtual_allocate_at(uintptr_t at, size_t count, size_t flags)
+void* virtual_allocate(size_t count, size_t flags)
 {
-	PhysicalMemoryStats stats = {};
-	physical_get_status(&stats);
+	return virtual_allocate(kernel_ranges_base, boot_info.kernel_virtual_base, count, flags);
+}
 
-	const size_t size = count * PAGE_SIZE;
-	uintptr_t start = to_higher_half(at);
-	uintptr_t end = kernel_address_request.response->virtual_base;
-	uintptr_t address = 0;
+void* virtual_allocate_large(size_t count, size_t flags)
+{
+	const size_t chunk = PAGE_SIZE_2MiB / PAGE_SIZE;
+	const size_t reserved = (count + VIRTUAL_GUARD_PAGES) * PAGE_SIZE;
+	const uintptr_t start = kernel_ranges.allocate(reserved, PAGE_SIZE_2MiB, kernel_ranges_base,
+												   boot_info.kernel_virtual_base);
 	PageMap* pagemap = get_current_pagemap();
+	size_t large_pages = 0;
 
-	do
+	if(start == 0)
 	{
-		for(address = start; address < (start + size); address += PAGE_SIZE)
-		{
-			if(pagemap->virtual_to_entry(address, false, PAGE_SIZE, true)->is_valid())
-			{
-				// Found a valid page
-				break;
-			}
-		}
+		return nullptr;
+	}
 
-		if(address >= (start + size))
+	for(size_t i = 0; i < count; i += chunk)
+	{
+		const uintptr_t virtual_address = start + (i * PAGE_SIZE);
+		const size_t pages = std::min(count - i, chunk);
+		void* block = (pages == chunk) ? physical_allocate_order(PHYS_ORDER_2MB) : nullptr;
+
+		if(block != nullptr)
 		{
-			for(size_t i = 0; i < size; i += PAGE_SIZE)
+			if(pagemap->map_range(virtual_address, reinterpret_cast<uintptr_t>(block),
+								  PAGE_SIZE_2MiB, flags | MAP_GLOBAL) == SYSTEM_OK)
 			{
-				if(pagemap->map_page(start + i, at + i, flags))
-				{
-					goto failure;
-				}
+				large_pages++;
+				continue;
 			}
 
-			pagemap->load();
-			return reinterpret_cast<void*>(start);
+			physical_free_order(block, PHYS_ORDER_2MB);
 		}
+		else if(map_frames(pagemap, virtual_address, pages, flags))
+		{
+			continue;
+		}
+
+		unmap_chunks(pagemap, start, i);
+		kernel_ranges.free(start, reserved);
+
+		return nullptr;
+	}
+
+	log_debug("Mapped %lu of %lu chunks at 0x%.16lx with 2 MiB pages", large_pages,
+			  div_roundup(count, chunk), start);
+
+	return reinterpret_cast<void*>(start);
+}
+
+void* virtual_allocate_at(uintptr_t at, size_t count, size_t flags)
+{
+	const size_t size = count * PAGE_SIZE;
+	const size_t reserved = size + (VIRTUAL_GUARD_PAGES * PAGE_SIZE);
 
-		start += PAGE_SIZE;
-	} while(start < end);
+	// Keep large enough physical ranges 2 MiB aligned, so map_range can use large pages.
+	const size_t align =
+		((size >= PAGE_SIZE_2MiB) && is_aligned(at, PAGE_SIZE_2MiB)) ? PAGE_SIZE_2MiB : PAGE_SIZE;
+	const uintptr_t start = kernel_ranges.allocate(reserved, align);
+
+	if(start == 0)
+	{
+		return nullptr;
+	}
+
+	if(get_current_pagemap()->map_range(start, at, size, flags | MAP_GLOBAL))
+	{
+		kernel_ranges.free(start, reserved);
+		return nullptr;
+	}
+
+	return reinterpret_cast<void*>(start);
+}
+
+void* virtual_direct_map(uintptr_t physical_address, size_t size)
+{
+	for(size_t i = 0; i < direct_range_count; i++)
+	{
+		if((physical_address >= direct_ranges[i].start) &&
+		   ((physical_address + size) <= direct_ranges[i].end))
+		{
+			return to_higher_half(reinterpret_cast<void*>(physical_address));
+		}
+	}
 
-failure:
-	pagemap->load();
 	return nullptr;
 }
 
 void virtual_free(void* ptr, size_t count)
 {
-	uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+	const uintptr_t address = align_down(reinterpret_cast<uintptr_t>(ptr), PAGE_SIZE);
+
+	unmap_frames(get_current_pagemap(), address, count);
+	kernel_ranges.free(address, (count + VIRTUAL_GUARD_PAGES) * PAGE_SIZE);
+}
+
+void virtual_free_at(void* ptr, size_t count)
+{
+	const uintptr_t address = align_down(reinterpret_cast<uintptr_t>(ptr), PAGE_SIZE);
 	PageMap* pagemap = get_current_pagemap();
 
-	address = align_down(address, PAGE_SIZE);
+	pagemap->unmap_range(address, count_mapped(pagemap, address, count) * PAGE_SIZE);
+	kernel_ranges.free(address, (count + VIRTUAL_GUARD_PAGES) * PAGE_SIZE);
+}
+
+void virtual_free_large(void* ptr, size_t count)
+{
+	const uintptr_t address = align_down(reinterpret_cast<uintptr_t>(ptr), PAGE_SIZE);
+
+	unmap_chunks(get_current_pagemap(), address, count);
+	kernel_ranges.free(address, (count + VIRTUAL_GUARD_PAGES) * PAGE_SIZE);
+}
+
+void* virtual_reserve(size_t count)
+{
+	const size_t size = count * PAGE_SIZE;
+	const uintptr_t start = kernel_ranges.allocate(size + (VIRTUAL_GUARD_PAGES * PAGE_SIZE),
+												   PAGE_SIZE);
 
-	for(size_t i = 0; i < count; i++)
+	if(start == 0)
 	{
-		uintptr_t physical_address = pagemap->virtual_to_physical(address);
+		return nullptr;
+	}
+
+	demand_ranges.free(start, size);
+	return reinterpret_cast<void*>(start);
+}
+
+void virtual_release(void* ptr, size_t count)
+{
+	const uintptr_t address = align_down(reinterpret_cast<uintptr_t>(ptr), PAGE_SIZE);
+	PageMap* pagemap = get_current_pagemap();
+	void* frames[VIRTUAL_ALLOCATE_BATCH];
+
+	if(!demand_ranges.reserve(address, count * PAGE_SIZE))
+	{
+		log_error("0x%.16lx is not a reserved region", address);
+		return;
+	}
 
-		if(physical_address == static_cast<size_t>(-1))
+	// Touched pages are scattered over the region, and the zero page is not theirs to free.
+	for(size_t i = 0; i < count; i += VIRTUAL_ALLOCATE_BATCH)
+	{
+		const size_t limit = std::min(count - i, VIRTUAL_ALLOCATE_BATCH);
+		size_t batch = 0;
+
+		for(size_t j = 0; j < limit; j++)
 		{
-			return;
+			const uintptr_t physical_address =
+				pagemap->virtual_to_physical(address + ((i + j) * PAGE_SIZE));
+
+			if((physical_address != static_cast<uintptr_t>(-1)) && (physical_address != zero_page))
+			{
+				frames[batch++] = reinterpret_cast<void*>(physical_address);
+			}
 		}
 
-		pagemap->unmap_page(address);
-		physical_free(reinterpret_cast<void*>(physical_address));
-		pagemap->load();
+		pagemap->unmap_range(address + (i * PAGE_SIZE), limit * PAGE_SIZE);
+		physical_free_bulk(frames, batch);
 	}
+
+	kernel_ranges.free(address, (count + VIRTUAL_GUARD_PAGES) * PAGE_SIZE);
 }
 
-void virtual_free_at(void* ptr, size_t count)
+bool virtual_handle_fault(uintptr_t address, bool write)
 {
-	uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+	const uintptr_t page = align_down(address, PAGE_SIZE);
 	PageMap* pagemap = get_current_pagemap();
 
-	address = align_down(address, PAGE_SIZE);
+	if(!demand_ranges.contains(page))
+	{
+		return false;
+	}
+
+	lock::ScopedLock guard(demand_lock);
 
-	for(size_t i = 0; i < count; i++)
+	// Another CPU may have backed the page while this one waited.
+	const uintptr_t current = pagemap->virtual_to_physical(page);
+
+	if((current != static_cast<uintptr_t>(-1)) && (!write || (current != zero_page)))
 	{
-		uintptr_t physical_address = pagemap->virtual_to_physical(address);
+		cpu::invalidate_page(page);
+		return true;
+	}
 
-		if(physical_address == static_cast<size_t>(-1))
-		{
-			return;
-		}
+	if(!write)
+	{
+		return pagemap->map_range(page, zero_page, PAGE_SIZE, MAP_READ | MAP_GLOBAL) == SYSTEM_OK;
+	}
+
+	const uintptr_t frame = physical_allocate<uintptr_t>();
+
+	if(frame == 0)
+	{
+		return false;
+	}
 
-		pagemap->unmap_page(address);
-		pagemap->load();
+	// Replacing the zero page invalidates its entry on every CPU that may have cached it.
+	if(pagemap->map_range(page, frame, PAGE_SIZE, MAP_READ | MAP_WRITE | MAP_GLOBAL) != SYSTEM_OK)
+	{
+		physical_free(reinterpret_cast<void*>(frame));
+		return false;
 	}
+
+	return true;
+}
+
+void virtual_get_status(VirtualRangeStats* status)
+{
+	kernel_ranges.get_status(status);
 }
 } // namespace memory
\ No newline at end of file
@@ -0,0 +1,393 @@
+#include <logger.h>
+
+#include <algorithm>
+
+#include <memory/memory.hpp>
+#include <memory/physical.hpp>
+#include <memory/virtual_range.hpp>
+
+namespace memory
+{
+static int height(VirtualRange* node)
+{
+	return (node == nullptr) ? 0 : node->height;
+}
+
+static size_t largest(VirtualRange* node)
+{
+	return (node == nullptr) ? 0 : node->largest;
+}
+
+static void update(VirtualRange* node)
+{
+	node->height = 1 + std::max(height(node->left), height(node->right));
+	node->largest = std::max({node->size, largest(node->left), largest(node->right)});
+}
+
+static VirtualRange* rotate_left(VirtualRange* node)
+{
+	VirtualRange* right = node->right;
+
+	node->right = right->left;
+	right->left = node;
+
+	update(node);
+	update(right);
+
+	return right;
+}
+
+static VirtualRange* rotate_right(VirtualRange* node)
+{
+	VirtualRange* left = node->left;
+
+	node->left = left->right;
+	left->right = node;
+
+	update(node);
+	update(left);
+
+	return left;
+}
+
+static VirtualRange* balance(VirtualRange* node)
+{
+	update(node);
+
+	const int factor = height(node->left) - height(node->right);
+
+	if(factor > 1)
+	{
+		if(height(node->left->left) < height(node->left->right))
+		{
+			node->left = rotate_left(node->left);
+		}
+
+		return rotate_right(node);
+	}
+	else if(factor < -1)
+	{
+		if(height(node->right->right) < height(node->right->left))
+		{
+			node->right = rotate_right(node->right);
+		}
+
+		return rotate_left(node);
+	}
+
+	return node;
+}
+
+static VirtualRange* insert(VirtualRange* node, VirtualRange* range)
+{
+	if(node == nullptr)
+	{
+		return range;
+	}
+
+	if(range->start < node->start)
+	{
+		node->left = insert(node->left, range);
+	}
+	else
+	{
+		node->right = insert(node->right, range);
+	}
+
+	return balance(node);
+}
+
+static VirtualRange* erase_min(VirtualRange* node, VirtualRange*& min)
+{
+	if(node->left == nullptr)
+	{
+		min = node;
+		return node->right;
+	}
+
+	node->left = erase_min(node->left, min);
+	return balance(node);
+}
+
+static VirtualRange* erase(VirtualRange* node, uintptr_t start)
+{
+	if(node == nullptr)
+	{
+		return nullptr;
+	}
+
+	if(start < node->start)
+	{
+		node->left = erase(node->left, start);
+	}
+	else if(start > node->start)
+	{
+		node->right = erase(node->right, start);
+	}
+	else
+	{
+		// Nodes are relinked rather than copied, so pointers to other ranges stay valid.
+		VirtualRange* left = node->left;
+		VirtualRange* right = node->right;
+		VirtualRange* min = nullptr;
+
+		if(right == nullptr)
+		{
+			return left;
+		}
+
+		right = erase_min(right, min);
+		min->left = left;
+		min->right = right;
+
+		return balance(min);
+	}
+
+	return balance(node);
+}
+
+void VirtualRangeAllocator::initialize(uintptr_t base, uintptr_t limit)
+{
+	lock::ScopedLock guard(this->lock_);
+
+	this->add(base, limit - base);
+}
+
+uintptr_t VirtualRangeAllocator::allocate(size_t size, size_t align, uintptr_t base,
+										  uintptr_t limit)
+{
+	lock::ScopedLock guard(this->lock_);
+
+	uintptr_t address = 0;
+	VirtualRange* range = this->find_fit(this->root_, size, std::max(align, PAGE_SIZE), base,
+										 limit, address);
+
+	if((size == 0) || (range == nullptr))
+	{
+		return 0;
+	}
+
+	const uintptr_t start = range->start;
+	const uintptr_t end = range->start + range->size;
+
+	this->remove(range);
+
+	if(address > start)
+	{
+		this->add(start, address - start);
+	}
+
+	if((address + size) < end)
+	{
+		this->add(address + size, end - (address + size));
+	}
+
+	return address;
+}
+
+bool VirtualRangeAllocator::reserve(uintptr_t address, size_t size)
+{
+	lock::ScopedLock guard(this->lock_);
+
+	VirtualRange* range = this->find_before(address + 1);
+
+	if((range == nullptr) || ((range->start + range->size) < (address + size)))
+	{
+		return false;
+	}
+
+	const uintptr_t start = range->start;
+	const uintptr_t end = range->start + range->size;
+
+	this->remove(range);
+
+	if(address > start)
+	{
+		this->add(start, address - start);
+	}
+
+	if((address + size) < end)
+	{
+		this->add(address + size, end - (address + size));
+	}
+
+	return true;
+}
+
+void VirtualRangeAllocator::free(uintptr_t address, size_t size)
+{
+	lock::ScopedLock guard(this->lock_);
+
+	VirtualRange* before = this->find_before(address);
+	VirtualRange* after = this->find_after(address);
+	uintptr_t start = address;
+	uintptr_t end = address + size;
+
+	if(((before != nullptr) && ((before->start + before->size) > start)) ||
+	   ((after != nullptr) && (after->start < end)))
+	{
+		log_error("Virtual range 0x%.16lx-0x%.16lx is already free", start, end);
+		return;
+	}
+
+	if((before != nullptr) && ((before->start + before->size) == start))
+	{
+		start = before->start;
+		this->remove(before);
+	}
+
+	if((after != nullptr) && (after->start == end))
+	{
+		end = after->start + after->size;
+		this->remove(after);
+	}
+
+	this->add(start, end - start);
+}
+
+bool VirtualRangeAllocator::contains(uintptr_t address)
+{
+	lock::ScopedLock guard(this->lock_);
+
+	VirtualRange* range = this->find_before(address + 1);
+
+	return (range != nullptr) && ((range->start + range->size) > address);
+}
+
+void VirtualRangeAllocator::get_status(VirtualRangeStats* status)
+{
+	lock::ScopedLock guard(this->lock_);
+
+	status->free_size = this->free_size_;
+	status->largest_free_range = largest(this->root_);
+	status->free_ranges = this->free_ranges_;
+}
+
+VirtualRange* VirtualRangeAllocator::allocate_node(uintptr_t start, size_t size)
+{
+	if(this->free_nodes_ == nullptr)
+	{
+		VirtualRange* nodes =
+			to_higher_half(physical_allocate<VirtualRange*>(1, PHYS_ALLOC_NO_ZERO));
+
+		for(size_t i = 0; i < (PAGE_SIZE / sizeof(VirtualRange)); i++)
+		{
+			this->free_node(&nodes[i]);
+		}
+	}
+
+	VirtualRange* node = this->free_nodes_;
+	this->free_nodes_ = node->right;
+
+	node->start = start;
+	node->size = size;
+	node->largest = size;
+	node->left = nullptr;
+	node->right = nullptr;
+	node->height = 1;
+
+	return node;
+}
+
+void VirtualRangeAllocator::free_node(VirtualRange* node)
+{
+	node->right = this->free_nodes_;
+	this->free_nodes_ = node;
+}
+
+// Finds the lowest fitting range. Subtrees that are too small or outside of the window are
+// skipped, only alignment can make a search look at a range that turns out not to fit.
+VirtualRange* VirtualRangeAllocator::find_fit(VirtualRange* node, size_t size, size_t align,
+											  uintptr_t base, uintptr_t limit, uintptr_t& address)
+{
+	if((node == nullptr) || (node->largest < size))
+	{
+		return nullptr;
+	}
+
+	if(node->start > base)
+	{
+		VirtualRange* ret = this->find_fit(node->left, size, align, base, limit, address);
+
+		if(ret != nullptr)
+		{
+			return ret;
+		}
+	}
+
+	const uintptr_t start = align_up(std::max(node->start, base), align);
+	const uintptr_t end = std::min(node->start + node->size, limit);
+
+	if((start < end) && ((end - start) >= size))
+	{
+		address = start;
+		return node;
+	}
+
+	if((node->start + node->size) < limit)
+	{
+		return this->find_fit(node->right, size, align, base, limit, address);
+	}
+
+	return nullptr;
+}
+
+VirtualRange* VirtualRangeAllocator::find_before(uintptr_t address)
+{
+	VirtualRange* node = this->root_;
+	VirtualRange* ret = nullptr;
+
+	while(node != nullptr)
+	{
+		if(node->start < address)
+		{
+			ret = node;
+			node = node->right;
+		}
+		else
+		{
+			node = node->left;
+		}
+	}
+
+	return ret;
+}
+
+VirtualRange* VirtualRangeAllocator::find_after(uintptr_t address)
+{
+	VirtualRange* node = this->root_;
+	VirtualRange* ret = nullptr;
+
+	while(node != nullptr)
+	{
+		if(node->start >= address)
+		{
+			ret = node;
+			node = node->left;
+		}
+		else
+		{
+			node = node->right;
+		}
+	}
+
+	return ret;
+}
+
+void VirtualRangeAllocator::remove(VirtualRange* range)
+{
+	this->free_size_ -= range->size;
+	this->free_ranges_--;
+
+	this->root_ = erase(this->root_, range->start);
+	this->free_node(range);
+}
+
+void VirtualRangeAllocator::add(uintptr_t start, size_t size)
+{
+	this->free_size_ += size;
+	this->free_ranges_++;
+
+	this->root_ = insert(this->root_, this->allocate_node(start, size));
+}
+} // namespace memory
\ No newline at end of file
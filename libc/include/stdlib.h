@@ -53,7 +53,11 @@ lldiv_t lldiv(long long int __numer, long long int __denom) __CONST;
 extern void* malloc(size_t __size) __MALLOC __ALLOC_SIZE(1) __WARN_UNUSED_RESULT;
 extern void* calloc(size_t __nmemb, size_t __size) __MALLOC __ALLOC_SIZE(1, 2) __WARN_UNUSED_RESULT;
 extern void* realloc(void* __ptr, size_t __new_size) __ALLOC_SIZE(2) __WARN_UNUSED_RESULT;
+extern void* aligned_alloc(size_t __alignment, size_t __size) __MALLOC __ALLOC_SIZE(2)
+	__WARN_UNUSED_RESULT;
 extern void free(void* __ptr);
+extern void free_sized(void* __ptr, size_t __size);
+extern void free_aligned_sized(void* __ptr, size_t __alignment, size_t __size);
 
 extern void abort(void) __NO_RETURN;
 